@@ -0,0 +1,63 @@
+//解释器分派循环测试，在紧凑的 label/if/goto 循环上测量每秒执行的指令数（IPS）
+//编译：
+//  cl /O2 /std:c++17 /EHsc /I..\JxCode.AtomScript DispatchBenchmark.cpp ..\JxCode.AtomScript\Interpreter.cpp ..\JxCode.AtomScript\Bytecode.cpp ..\JxCode.AtomScript\Optimizer.cpp ..\JxCode.AtomScript\Jit.cpp ..\JxCode.AtomScript\ProgramImage.cpp ..\JxCode.AtomScript\ProgramCache.cpp ..\JxCode.AtomScript\LazyProgram.cpp ..\JxCode.AtomScript\StringPool.cpp ..\JxCode.AtomScript\SymbolTable.cpp ..\JxCode.AtomScript\OpCommand.cpp ..\JxCode.AtomScript\StreamParser.cpp ..\JxCode.AtomScript\ParallelParser.cpp ..\JxCode.AtomScript\Lexer.cpp ..\JxCode.AtomScript\Token.cpp ..\JxCode.AtomScript\CharScan.cpp ..\JxCode.AtomScript\Utf8.cpp ..\JxCode.AtomScript\Variable.cpp ..\JxCode.AtomScript\wexceptionbase.cpp
+//  MSVC只有switch分派；GCC/Clang默认使用计算goto，加 -DATOMSCRIPT_SWITCH_DISPATCH 得到switch分派用于对比
+//用法：DispatchBenchmark [循环次数] [jit]，指定jit时启用热循环即时编译
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include "Interpreter.h"
+
+using namespace std;
+using namespace jxcode::atomscript;
+
+//每轮循环执行4条指令：调用、赋值、条件、跳转
+static const int kInstructionsPerLoop = 4;
+
+static wstring GenerateScript(long long loops)
+{
+    return
+        L"$i = 0\n"
+        L"$n = " + to_wstring(loops) + L"\n"
+        L"::loop\n"
+        L"@math.add: i, 1\n"
+        L"$i = __return\n"
+        L"? i < n then >> loop\n";
+}
+
+int main(int argc, char** argv)
+{
+    long long loops = argc > 1 ? atoll(argv[1]) : 1000000;
+    wstring code = GenerateScript(loops);
+
+    bool is_end = false;
+    Interpreter interpreter(
+        [&code](const wstring&) { return code; },
+        [](const int32_t&, const vector<jxcode::lexer::Token>&, const vector<jxcode::lexer::Token>&, const vector<Variable>&) { return true; },
+        [&is_end](const wstring&) { is_end = true; });
+
+    bool is_jit = argc > 2 && string(argv[2]) == "jit" && interpreter.SetJit(true);
+
+    auto begin = chrono::steady_clock::now();
+    interpreter.ExecuteProgram(L"bench");
+    while (interpreter.Next());
+    auto end = chrono::steady_clock::now();
+
+    double seconds = chrono::duration<double>(end - begin).count();
+    double instructions = (double)loops * kInstructionsPerLoop;
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(ATOMSCRIPT_SWITCH_DISPATCH)
+    const char* dispatch = "threaded";
+#else
+    const char* dispatch = "switch";
+#endif
+
+    cout << "dispatch: " << dispatch << (is_jit ? " + jit" : "") << endl;
+    cout << "loops:    " << loops << ", " << seconds << " s" << endl;
+    cout << "IPS:      " << instructions / seconds / 1e6 << " M/s" << endl;
+    if (!is_end) {
+        cout << "program did not finish" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+//词法分析吞吐量测试，对比逐字符扫描与批量扫描（scan_vectorized）
+//编译：
+//  cl /O2 /std:c++17 /EHsc /I..\JxCode.AtomScript LexerBenchmark.cpp ..\JxCode.AtomScript\Lexer.cpp ..\JxCode.AtomScript\Token.cpp ..\JxCode.AtomScript\CharScan.cpp ..\JxCode.AtomScript\Utf8.cpp ..\JxCode.AtomScript\wexceptionbase.cpp
+//  加 /arch:AVX2 使用AVX2实现
+//用法：LexerBenchmark [脚本文件]，不指定文件时使用生成的脚本
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <string>
+#include <memory>
+#include "Lexer.h"
+#include "CharScan.h"
+
+using namespace std;
+using namespace jxcode::lexer;
+
+static wstring GenerateScript(size_t target_length)
+{
+    wstring unit =
+        L"// generated benchmark script, long single line comment to exercise note scanning\n"
+        L"$counter_value = 0\n"
+        L"    set message_text = \"hello atom script\"\n"
+        L"/* multiline comment\n"
+        L"   spanning several lines of text\n"
+        L"*/\n"
+        L"::loop_label_name\n"
+        L"@math.add: counter_value, 1\n"
+        L"$counter_value = __return\n"
+        L"\tif counter_value < 100000 then goto loop_label_name\n"
+        L"@strlib.cat: message_text, \" world\"\n"
+        L"$escaped = \"tab\\tnewline\\n\"\n"
+        L"$negative_number = -12.5\n";
+    wstring code;
+    code.reserve(target_length + unit.length());
+    while (code.length() < target_length) {
+        code += unit;
+    }
+    return code;
+}
+
+static wstring ReadAllText(const char* path)
+{
+    wifstream ifs(path);
+    if (!ifs.is_open()) {
+        throw std::invalid_argument("Unable to open file");
+    }
+    wstringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+static double Measure(const shared_ptr<const wstring>& code, bool vectorized, int rounds, size_t* token_count)
+{
+    Lexer lexer(get_std_operator_map(), get_std_esc_char_map());
+    lexer.scan_vectorized = vectorized;
+    lexer.scan_is_parse_note = true;
+
+    *token_count = lexer.Scan(code).tokens.size(); //预热
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        *token_count = lexer.Scan(code).tokens.size();
+    }
+    auto end = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(end - begin).count();
+    double mb = (double)(code->length() * sizeof(wchar_t)) * rounds / (1024.0 * 1024.0);
+    return mb / seconds;
+}
+
+int main(int argc, char** argv)
+{
+    shared_ptr<const wstring> code;
+    if (argc > 1) {
+        code = make_shared<const wstring>(ReadAllText(argv[1]));
+    }
+    else {
+        code = make_shared<const wstring>(GenerateScript(4 * 1024 * 1024));
+    }
+    const int rounds = 10;
+
+    size_t scalar_tokens = 0, vector_tokens = 0;
+    double scalar = Measure(code, false, rounds, &scalar_tokens);
+    double vector = Measure(code, true, rounds, &vector_tokens);
+
+    cout << "source: " << code->length() << " chars, " << vector_tokens << " tokens" << endl;
+    cout << "scalar:     " << scalar << " MB/s" << endl;
+    cout << "vectorized: " << vector << " MB/s (" << charscan::ImplName() << ")" << endl;
+    cout << "speedup:    " << vector / scalar << "x" << endl;
+    if (scalar_tokens != vector_tokens) {
+        cout << "token count mismatch" << endl;
+        return 1;
+    }
+    return 0;
+}
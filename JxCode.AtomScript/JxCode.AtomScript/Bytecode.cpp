@@ -0,0 +1,375 @@
+#include "Bytecode.h"
+#include "Optimizer.h"
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace jxcode::atomscript
+{
+    using namespace std;
+    using namespace lexer;
+
+    using StringIndexMap = unordered_map<wstring_view, int32_t>;
+
+    struct CompileContext
+    {
+        Program* program;
+        StringIndexMap string_index;
+        const LabelMap* labels;
+        SymbolTable* symbols;
+    };
+
+    inline static Operand MakeOperand(CompileContext* ctx, const Token& token)
+    {
+        Program* program = ctx->program;
+        StringIndexMap* string_index = &ctx->string_index;
+
+        Operand op;
+        op.kind = OperandKind::Ident;
+        op.str = 0;
+        op.token = &token;
+
+        if (token.token_type == TokenType::Number) {
+            try {
+                op.num = stof(wstring(token.value));
+                op.kind = OperandKind::Number;
+            }
+            catch (const std::exception&) {
+                op.kind = OperandKind::NumberText;
+            }
+        }
+        else if (token.token_type == TokenType::String) {
+            auto it = string_index->find(token.value);
+            if (it == string_index->end()) {
+                it = string_index->emplace(token.value, (int32_t)program->strings.size()).first;
+                program->strings.push_back(token.value);
+            }
+            op.kind = OperandKind::String;
+            op.str = it->second;
+        }
+        else {
+            op.slot = ctx->symbols->Intern(token.value);
+        }
+        return op;
+    }
+
+    inline static Instruction MakeInstruction(const OpCommand& cmd, InstrCode code)
+    {
+        Instruction ins;
+        ins.code = code;
+        ins.compare = TokenType::Unknow;
+        ins.jump = -1;
+        ins.x = Operand{ OperandKind::None, {0}, nullptr };
+        ins.y = Operand{ OperandKind::None, {0}, nullptr };
+        ins.cmd = &cmd;
+        ins.error = nullptr;
+        ins.is_unstable = false;
+        ins.label_ptr = 0;
+        return ins;
+    }
+
+    inline static Instruction MakeError(const OpCommand& cmd, const Token& token, const wchar_t* message)
+    {
+        Instruction ins = MakeInstruction(cmd, InstrCode::Error);
+        ins.x.token = &token;
+        ins.error = message;
+        return ins;
+    }
+
+    inline static bool IsIdent(const Token& token)
+    {
+        return token.token_type == TokenType::Ident;
+    }
+
+    static CallShape DecodeCall(CompileContext* ctx, const TokenSpan& t, bool is_instance)
+    {
+        CallShape shape;
+        shape.target = CallTarget::Host;
+        shape.error = nullptr;
+
+        size_t index = is_instance ? 1 : 0;
+        bool is_symbol = is_instance;       //实例先看下一个符号是什么
+        bool is_last_domain = !is_instance; //静态从顶级域开始查找
+        bool is_last_path = false;
+
+        for (; index < t.size(); index++) {
+            const Token& token = t[index];
+
+            if (is_symbol) {
+                if (token.token_type == TokenType::DoubleColon) {
+                    //域运算符
+                    is_last_domain = true;
+                }
+                else if (token.token_type == TokenType::Dot) {
+                    //子对象运算符
+                    is_last_path = true;
+                }
+                else if (token.token_type == TokenType::Colon) {
+                    //函数运算符，退出
+                    index++;
+                    break;
+                }
+                else {
+                    shape.error = &token;
+                    return shape;
+                }
+                is_symbol = false;
+            }
+            else {
+                if (is_last_domain) {
+                    shape.domain.push_back(token);
+                    is_last_domain = false;
+                }
+                if (is_last_path) {
+                    shape.path.push_back(token);
+                    is_last_path = false;
+                }
+                is_symbol = true;
+            }
+        }
+
+        bool should_be_comma = false;
+        for (; index < t.size(); index++) {
+            const Token& token = t[index];
+            if (token.token_type == TokenType::Comma) {
+                //是逗号直接忽略
+                if (should_be_comma) {
+                    should_be_comma = false;
+                    continue;
+                }
+                //是逗号但不应该是逗号，该参数被省略
+                shape.args.push_back(Operand{ OperandKind::None, {0}, &token });
+            }
+            else {
+                shape.args.push_back(MakeOperand(ctx, token));
+                should_be_comma = true;
+            }
+        }
+
+        if (shape.domain.size() == 1) {
+            if (shape.domain[0].value == L"math") {
+                shape.target = CallTarget::Math;
+            }
+            else if (shape.domain[0].value == L"strlib") {
+                shape.target = CallTarget::Strlib;
+            }
+            if (shape.target != CallTarget::Host && !shape.path.empty()) {
+                shape.function = shape.path[0].value;
+            }
+        }
+        return shape;
+    }
+
+    static Instruction CompileCommand(CompileContext* ctx, const OpCommand& cmd)
+    {
+        const LabelMap& labels = *ctx->labels;
+        const TokenSpan& t = cmd.targets;
+
+        switch (cmd.code)
+        {
+        case OpCode::Call:
+        {
+            if (t.empty()) {
+                return MakeError(cmd, cmd.op_token, L"arguments error");
+            }
+            CallSite site;
+            site.id = (int32_t)ctx->program->call_sites.size();
+            site.object_slot = ctx->symbols->Intern(t[0].value);
+            site.object_token = &t[0];
+            site.static_call = DecodeCall(ctx, t, false);
+            site.instance_call = DecodeCall(ctx, t, true);
+            ctx->program->call_sites.push_back(std::move(site));
+
+            Instruction ins = MakeInstruction(cmd, InstrCode::Call);
+            ins.jump = ctx->program->call_sites.back().id;
+            return ins;
+        }
+        case OpCode::Label:
+            return MakeInstruction(cmd, InstrCode::Nop);
+        case OpCode::If:
+        {
+            Instruction ins = MakeInstruction(cmd, InstrCode::If);
+            ins.x = MakeOperand(ctx, t[0]);
+            ins.compare = t[1].token_type;
+            ins.y = MakeOperand(ctx, t[2]);
+            return ins;
+        }
+        case OpCode::Goto:
+        {
+            if (t.size() == 1) {
+                auto it = labels.find(wstring(t[0].value));
+                if (it == labels.end()) {
+                    return MakeError(cmd, cmd.op_token, L"Label not found.");
+                }
+                Instruction ins = MakeInstruction(cmd, InstrCode::Goto);
+                ins.jump = (int32_t)it->second;
+                return ins;
+            }
+            else if (t.size() == 2) {
+                Instruction ins = MakeInstruction(cmd, InstrCode::GotoVar);
+                ins.x = MakeOperand(ctx, t[1]);
+                return ins;
+            }
+            return MakeError(cmd, cmd.op_token, L"goto语句错误");
+        }
+        case OpCode::Set:
+        {
+            //暂时不用表达式，只使用一个值
+            if (t.size() != 3) {
+                return MakeError(cmd, cmd.op_token, L"arguments error");
+            }
+            if (!IsIdent(t[0])) {
+                return MakeError(cmd, t[0], L"argument not is ident");
+            }
+            if (t[1].token_type != TokenType::Equal) {
+                return MakeError(cmd, t[1], L"token type error");
+            }
+            TokenType type = t[2].token_type;
+            if (type != TokenType::Number && type != TokenType::String && type != TokenType::Ident) {
+                return MakeInstruction(cmd, InstrCode::Nop);
+            }
+            Instruction ins = MakeInstruction(cmd, InstrCode::Set);
+            ins.x = MakeOperand(ctx, t[0]);
+            ins.y = MakeOperand(ctx, t[2]);
+            return ins;
+        }
+        case OpCode::Del:
+        case OpCode::ClearSub:
+        {
+            if (t.size() != 1) {
+                return MakeError(cmd, cmd.op_token, L"arguments error");
+            }
+            if (!IsIdent(t[0])) {
+                return MakeError(cmd, t[0], L"argument not is ident");
+            }
+            Instruction ins = MakeInstruction(cmd, cmd.code == OpCode::Del ? InstrCode::Del : InstrCode::ClearSub);
+            ins.x = MakeOperand(ctx, t[0]);
+            return ins;
+        }
+        case OpCode::ToProg:
+        {
+            if (t.size() != 1) {
+                return MakeError(cmd, cmd.op_token, L"arguments error");
+            }
+            //标识符需要在执行时检查变量类型
+            if (t[0].token_type != TokenType::String && !IsIdent(t[0])) {
+                return MakeError(cmd, t[0], L"type error");
+            }
+            Instruction ins = MakeInstruction(cmd, InstrCode::ToProg);
+            ins.x = MakeOperand(ctx, t[0]);
+            return ins;
+        }
+        default:
+            return MakeError(cmd, cmd.op_token, L"unknow opcode");
+        }
+    }
+
+    inline static bool IsLiteral(const Operand& op)
+    {
+        return op.kind == OperandKind::Number || op.kind == OperandKind::String;
+    }
+
+    //交换比较运算符两侧时对应的运算符
+    inline static TokenType MirrorCompare(TokenType type)
+    {
+        switch (type)
+        {
+        case TokenType::GreaterThan: return TokenType::LessThan;
+        case TokenType::GreaterThanEqual: return TokenType::LessThanEqual;
+        case TokenType::LessThan: return TokenType::GreaterThan;
+        case TokenType::LessThanEqual: return TokenType::GreaterThanEqual;
+        default: return type;
+        }
+    }
+
+    //把 if ... then goto 合并为一条条件跳转，并按字面值类型选择比较方式
+    static void FuseBranches(Program* program, size_t count)
+    {
+        for (size_t i = 0; i + 1 < count; i++) {
+            Instruction& ins = program->code[i];
+            const Instruction& next = program->code[i + 1];
+            if (ins.code != InstrCode::If) {
+                continue;
+            }
+            if (next.code == InstrCode::GotoVar) {
+                ins.code = InstrCode::IfGotoVar;
+                continue;
+            }
+            if (next.code != InstrCode::Goto) {
+                continue;
+            }
+            ins.code = InstrCode::IfGoto;
+            ins.jump = next.jump;
+
+            //字面值统一放在右侧
+            if (IsLiteral(ins.x) && ins.y.kind == OperandKind::Ident) {
+                std::swap(ins.x, ins.y);
+                ins.compare = MirrorCompare(ins.compare);
+            }
+            if (ins.x.kind != OperandKind::Ident) {
+                continue;
+            }
+            if (ins.y.kind == OperandKind::Number) {
+                ins.code = InstrCode::IfGotoNum;
+            }
+            else if (ins.y.kind == OperandKind::String && ins.compare == TokenType::DoubleEqual) {
+                ins.code = InstrCode::IfGotoStr;
+            }
+        }
+    }
+
+    Program CompileProgram(const CommandList& commands, const LabelMap& labels, SymbolTable* symbols, bool optimize)
+    {
+        Program program;
+        CompileContext ctx{ &program, StringIndexMap(), &labels, symbols };
+
+        program.code.reserve(commands.size() + 2);
+        for (size_t i = 0; i < commands.size(); i++) {
+            program.code.push_back(CompileCommand(&ctx, commands[i]));
+        }
+        if (optimize) {
+            OptimizeProgram(&program, commands.size());
+        }
+        FuseBranches(&program, commands.size());
+        //If在最后一行不成立时会跳过两条
+        Instruction end;
+        end.code = InstrCode::End;
+        end.compare = TokenType::Unknow;
+        end.jump = -1;
+        end.x = Operand{ OperandKind::None, {0}, nullptr };
+        end.y = Operand{ OperandKind::None, {0}, nullptr };
+        end.cmd = nullptr;
+        end.error = nullptr;
+        end.is_unstable = false;
+        end.label_ptr = 0;
+        program.code.push_back(end);
+        program.code.push_back(end);
+        return program;
+    }
+
+    inline static void RemapOperand(Operand* op, const vector<int32_t>& slots)
+    {
+        if (op->kind == OperandKind::Ident) {
+            op->slot = slots[op->slot];
+        }
+    }
+
+    Program RemapSlots(const Program& program, const vector<int32_t>& slots)
+    {
+        Program result = program;
+        for (Instruction& ins : result.code) {
+            RemapOperand(&ins.x, slots);
+            RemapOperand(&ins.y, slots);
+        }
+        for (CallSite& site : result.call_sites) {
+            site.object_slot = slots[site.object_slot];
+            for (Operand& arg : site.static_call.args) {
+                RemapOperand(&arg, slots);
+            }
+            for (Operand& arg : site.instance_call.args) {
+                RemapOperand(&arg, slots);
+            }
+        }
+        return result;
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <map>
+#include <unordered_map>
+#include "Token.h"
+#include "OpCommand.h"
+#include "SymbolTable.h"
+
+namespace jxcode::atomscript
+{
+    enum class OperandKind : uint8_t
+    {
+        None,
+        Number,
+        //超出float范围的数字，执行时按原来的方式转换并抛出异常
+        NumberText,
+        String,
+        //变量，按槽位访问
+        Ident,
+    };
+
+    struct Operand
+    {
+        OperandKind kind;
+        union {
+            float num;
+            int32_t str;  //Program::strings中的下标
+            int32_t slot; //变量槽位
+        };
+        const lexer::Token* token; //源Token，变量名与报错使用
+    };
+
+    enum class InstrCode : uint8_t
+    {
+        Nop,
+        Call,
+        If,
+        Goto,
+        GotoVar,
+        Set,
+        Del,
+        ClearSub,
+        ToProg,
+        //编译时发现的错误，执行到时抛出
+        Error,
+        //If与下一行的Goto合并的条件跳转，下一行保留原指令，条件不成立时跳过两行
+        IfGoto,
+        //变量与数字字面值比较
+        IfGotoNum,
+        //变量与字符串字面值判等，不分配临时字符串
+        IfGotoStr,
+        //If与下一行的goto var合并
+        IfGotoVar,
+        //以下为执行时按操作数类型改写的快速指令，类型不符时改回通用指令
+        //Set数字字面值
+        SetNumLiteral,
+        //If两侧都是数字
+        CmpNumNum,
+        //If两侧都是字符串变量，或变量与字符串字面值判等
+        CmpStrPtrEq,
+        //IfGoto两侧都是数字
+        IfGotoNumNum,
+        //IfGoto两侧都是字符串变量，或变量与字符串字面值判等
+        IfGotoStrPtrEq,
+        //延迟编译时块的入口，jump为块序号，编译后改写为Goto
+        EnterBlock,
+        //程序结尾
+        End,
+    };
+
+    //指令与命令一一对应，exec_ptr_同时是命令与指令的下标，指令末尾另有两条End
+    struct Instruction
+    {
+        InstrCode code;
+        lexer::TokenType compare; //If的比较运算符
+        int32_t jump;             //Goto与IfGoto的目标下标，Call的调用点下标，goto var缓存的标签下标
+        Operand x;
+        Operand y;
+        const OpCommand* cmd;     //源命令
+        const wchar_t* error;     //Error的报错信息，报错Token为x.token
+        bool is_unstable;         //快速指令的类型检查失败过，不再改写
+        int32_t label_ptr;        //goto var上次查找的字符串指针，0表示没有缓存
+    };
+
+    enum class CallTarget : uint8_t
+    {
+        Host,
+        Math,
+        Strlib,
+    };
+
+    //一种解码方式下的调用目标与参数
+    struct CallShape
+    {
+        CallTarget target;
+        std::vector<lexer::Token> domain;
+        std::vector<lexer::Token> path;
+        std::wstring function;      //内置库的函数名
+        std::vector<Operand> args;  //被省略的参数为None
+        const lexer::Token* error;  //域与路径的解析错误，为空表示没有错误
+    };
+
+    //调用点在加载时解码，第一个Token是已定义的变量时按实例调用，否则按静态调用
+    struct CallSite
+    {
+        int32_t id;
+        int32_t object_slot;
+        const lexer::Token* object_token;
+        CallShape static_call;
+        CallShape instance_call;
+    };
+
+    //编译后的程序，字面值与跳转目标在加载时确定
+    //指令引用CommandList（或ProgramImage）中的Token，需要与程序同时存活
+    class Program
+    {
+    public:
+        std::vector<Instruction> code;
+        std::vector<std::wstring_view> strings;
+        std::vector<CallSite> call_sites;
+    public:
+        size_t size() const { return this->code.size(); }
+    };
+
+    //标签名到标签命令的下标
+    using LabelMap = std::unordered_map<std::wstring, size_t>;
+
+    //标识符在symbols中分配槽位，optimize为true时进行数据流优化
+    Program CompileProgram(
+        const CommandList& commands,
+        const LabelMap& labels,
+        SymbolTable* symbols,
+        bool optimize = false);
+
+    //复制程序，槽位i换成slots[i]，用于把另一个符号表下编译的程序交给当前解释器
+    Program RemapSlots(const Program& program, const std::vector<int32_t>& slots);
+
+    //数字比较，执行与加载时求值共用
+    inline bool NumberCompare(lexer::TokenType eqtype, float x, float y)
+    {
+        switch (eqtype)
+        {
+        case lexer::TokenType::DoubleEqual: return x == y;
+        case lexer::TokenType::ExclamatoryAndEqual: return x != y;
+        case lexer::TokenType::GreaterThan: return x > y;
+        case lexer::TokenType::GreaterThanEqual: return x >= y;
+        case lexer::TokenType::LessThan: return x < y;
+        case lexer::TokenType::LessThanEqual: return x <= y;
+        default: return false;
+        }
+    }
+}
@@ -0,0 +1,329 @@
+#include "CharScan.h"
+
+#if defined(__AVX2__)
+#define ATOMSCRIPT_SCAN_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ATOMSCRIPT_SCAN_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace jxcode::lexer::charscan
+{
+    template<typename CharT>
+    inline static bool IsSpace(CharT c)
+    {
+        return (GetCharClass(c) & kCharSpace) != 0;
+    }
+    template<typename CharT>
+    inline static bool IsIdentStop(CharT c)
+    {
+        return (GetCharClass(c) & kCharIdentStop) != 0;
+    }
+
+#if defined(ATOMSCRIPT_SCAN_AVX2) || defined(ATOMSCRIPT_SCAN_SSE2)
+
+    inline static uint32_t CountTrailingZero(uint32_t x)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, x);
+        return (uint32_t)index;
+#else
+        return (uint32_t)__builtin_ctz(x);
+#endif
+    }
+    inline static uint32_t PopCount(uint32_t x)
+    {
+        x = x - ((x >> 1) & 0x55555555u);
+        x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+        return (((x + (x >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+    }
+
+#ifdef ATOMSCRIPT_SCAN_AVX2
+    struct Vec
+    {
+        using type = __m256i;
+        static constexpr size_t kBytes = 32;
+        static constexpr uint32_t kFullMask = 0xFFFFFFFFu;
+        static type load(const void* p) { return _mm256_loadu_si256((const __m256i*)p); }
+        static type zero() { return _mm256_setzero_si256(); }
+        static type set8(int v) { return _mm256_set1_epi8((char)v); }
+        static type set16(int v) { return _mm256_set1_epi16((short)v); }
+        static type set32(int v) { return _mm256_set1_epi32(v); }
+        static type sub8(type a, type b) { return _mm256_sub_epi8(a, b); }
+        static type sub16(type a, type b) { return _mm256_sub_epi16(a, b); }
+        static type sub32(type a, type b) { return _mm256_sub_epi32(a, b); }
+        static type subs_u8(type a, type b) { return _mm256_subs_epu8(a, b); }
+        static type subs_u16(type a, type b) { return _mm256_subs_epu16(a, b); }
+        static type eq8(type a, type b) { return _mm256_cmpeq_epi8(a, b); }
+        static type eq16(type a, type b) { return _mm256_cmpeq_epi16(a, b); }
+        static type eq32(type a, type b) { return _mm256_cmpeq_epi32(a, b); }
+        static type gt32(type a, type b) { return _mm256_cmpgt_epi32(a, b); }
+        static type or_(type a, type b) { return _mm256_or_si256(a, b); }
+        static type xor_(type a, type b) { return _mm256_xor_si256(a, b); }
+        static uint32_t mask(type a) { return (uint32_t)_mm256_movemask_epi8(a); }
+    };
+#else
+    struct Vec
+    {
+        using type = __m128i;
+        static constexpr size_t kBytes = 16;
+        static constexpr uint32_t kFullMask = 0xFFFFu;
+        static type load(const void* p) { return _mm_loadu_si128((const __m128i*)p); }
+        static type zero() { return _mm_setzero_si128(); }
+        static type set8(int v) { return _mm_set1_epi8((char)v); }
+        static type set16(int v) { return _mm_set1_epi16((short)v); }
+        static type set32(int v) { return _mm_set1_epi32(v); }
+        static type sub8(type a, type b) { return _mm_sub_epi8(a, b); }
+        static type sub16(type a, type b) { return _mm_sub_epi16(a, b); }
+        static type sub32(type a, type b) { return _mm_sub_epi32(a, b); }
+        static type subs_u8(type a, type b) { return _mm_subs_epu8(a, b); }
+        static type subs_u16(type a, type b) { return _mm_subs_epu16(a, b); }
+        static type eq8(type a, type b) { return _mm_cmpeq_epi8(a, b); }
+        static type eq16(type a, type b) { return _mm_cmpeq_epi16(a, b); }
+        static type eq32(type a, type b) { return _mm_cmpeq_epi32(a, b); }
+        static type gt32(type a, type b) { return _mm_cmpgt_epi32(a, b); }
+        static type or_(type a, type b) { return _mm_or_si128(a, b); }
+        static type xor_(type a, type b) { return _mm_xor_si128(a, b); }
+        static uint32_t mask(type a) { return (uint32_t)_mm_movemask_epi8(a); }
+    };
+#endif
+
+    using vec_t = Vec::type;
+
+    //char为1字节，wchar_t在Windows为2字节，在Linux为4字节
+    template<size_t W> struct Lane;
+
+    template<> struct Lane<1>
+    {
+        static vec_t Eq(vec_t x, int c)
+        {
+            return Vec::eq8(x, Vec::set8(c));
+        }
+        static vec_t InRange(vec_t x, int lo, int hi)
+        {
+            //(x - lo) <= (hi - lo)，无符号饱和减法为0即在范围内
+            vec_t d = Vec::sub8(x, Vec::set8(lo));
+            return Vec::eq8(Vec::subs_u8(d, Vec::set8(hi - lo)), Vec::zero());
+        }
+    };
+
+    template<> struct Lane<2>
+    {
+        static vec_t Eq(vec_t x, int c)
+        {
+            return Vec::eq16(x, Vec::set16(c));
+        }
+        static vec_t InRange(vec_t x, int lo, int hi)
+        {
+            vec_t d = Vec::sub16(x, Vec::set16(lo));
+            return Vec::eq16(Vec::subs_u16(d, Vec::set16(hi - lo)), Vec::zero());
+        }
+    };
+
+    template<> struct Lane<4>
+    {
+        static vec_t Eq(vec_t x, int c)
+        {
+            return Vec::eq32(x, Vec::set32(c));
+        }
+        static vec_t InRange(vec_t x, int lo, int hi)
+        {
+            //无符号比较通过翻转符号位转为有符号比较
+            const vec_t bias = Vec::set32((int)0x80000000);
+            vec_t d = Vec::xor_(Vec::sub32(x, Vec::set32(lo)), bias);
+            vec_t out = Vec::gt32(d, Vec::set32((int)((uint32_t)(hi - lo) ^ 0x80000000u)));
+            return Vec::eq32(out, Vec::zero());
+        }
+    };
+
+    template<typename CharT>
+    struct Scanner
+    {
+        using L = Lane<sizeof(CharT)>;
+        static constexpr size_t kLanes = Vec::kBytes / sizeof(CharT);
+
+        static uint32_t SpaceMask(vec_t x)
+        {
+            return Vec::mask(Vec::or_(Vec::or_(L::Eq(x, ' '), L::Eq(x, '\t')), L::Eq(x, '\r')));
+        }
+        static uint32_t IdentStopMask(vec_t x)
+        {
+            vec_t m = Vec::or_(L::Eq(x, ' '), L::Eq(x, '\r'));
+            m = Vec::or_(m, Vec::or_(L::Eq(x, '\n'), L::Eq(x, 0)));
+            m = Vec::or_(m, Vec::or_(L::InRange(x, 33, 47), L::InRange(x, 58, 64)));
+            m = Vec::or_(m, Vec::or_(L::InRange(x, 91, 94), L::Eq(x, 96)));
+            m = Vec::or_(m, L::InRange(x, 123, 126));
+            return Vec::mask(m);
+        }
+
+        static const CharT* SkipSpace(const CharT* p, const CharT* end)
+        {
+            while ((size_t)(end - p) >= kLanes) {
+                uint32_t m = SpaceMask(Vec::load(p)) ^ Vec::kFullMask;
+                if (m) {
+                    return p + CountTrailingZero(m) / sizeof(CharT);
+                }
+                p += kLanes;
+            }
+            while (p < end && IsSpace(*p)) ++p;
+            return p;
+        }
+
+        static const CharT* FindIdentEnd(const CharT* p, const CharT* end)
+        {
+            while ((size_t)(end - p) >= kLanes) {
+                uint32_t m = IdentStopMask(Vec::load(p));
+                if (m) {
+                    return p + CountTrailingZero(m) / sizeof(CharT);
+                }
+                p += kLanes;
+            }
+            while (p < end && !IsIdentStop(*p)) ++p;
+            return p;
+        }
+
+        static const CharT* FindChar(const CharT* p, const CharT* end, CharT c)
+        {
+            while ((size_t)(end - p) >= kLanes) {
+                uint32_t m = Vec::mask(L::Eq(Vec::load(p), (int)c));
+                if (m) {
+                    return p + CountTrailingZero(m) / sizeof(CharT);
+                }
+                p += kLanes;
+            }
+            while (p < end && *p != c) ++p;
+            return p;
+        }
+
+        static size_t CountChar(const CharT* p, const CharT* end, CharT c)
+        {
+            size_t count = 0;
+            while ((size_t)(end - p) >= kLanes) {
+                count += PopCount(Vec::mask(L::Eq(Vec::load(p), (int)c))) / sizeof(CharT);
+                p += kLanes;
+            }
+            for (; p < end; ++p) {
+                if (*p == c) ++count;
+            }
+            return count;
+        }
+    };
+
+    size_t CountColumn(const char* p, const char* end)
+    {
+        size_t count = (size_t)(end - p);
+        while ((size_t)(end - p) >= Vec::kBytes) {
+            count -= PopCount(Vec::mask(Lane<1>::InRange(Vec::load(p), 0x80, 0xBF)));
+            p += Vec::kBytes;
+        }
+        for (; p < end; ++p) {
+            if (IsUtf8Continuation(*p)) --count;
+        }
+        return count;
+    }
+
+    const char* ImplName()
+    {
+#ifdef ATOMSCRIPT_SCAN_AVX2
+        return "avx2";
+#else
+        return "sse2";
+#endif
+    }
+
+#else
+
+    template<typename CharT>
+    struct Scanner
+    {
+        static const CharT* SkipSpace(const CharT* p, const CharT* end)
+        {
+            while (p < end && IsSpace(*p)) ++p;
+            return p;
+        }
+
+        static const CharT* FindIdentEnd(const CharT* p, const CharT* end)
+        {
+            while (p < end && !IsIdentStop(*p)) ++p;
+            return p;
+        }
+
+        static const CharT* FindChar(const CharT* p, const CharT* end, CharT c)
+        {
+            while (p < end && *p != c) ++p;
+            return p;
+        }
+
+        static size_t CountChar(const CharT* p, const CharT* end, CharT c)
+        {
+            size_t count = 0;
+            for (; p < end; ++p) {
+                if (*p == c) ++count;
+            }
+            return count;
+        }
+    };
+
+    size_t CountColumn(const char* p, const char* end)
+    {
+        size_t count = 0;
+        for (; p < end; ++p) {
+            if (!IsUtf8Continuation(*p)) ++count;
+        }
+        return count;
+    }
+
+    const char* ImplName()
+    {
+        return "scalar";
+    }
+
+#endif
+
+    const wchar_t* SkipSpace(const wchar_t* p, const wchar_t* end)
+    {
+        return Scanner<wchar_t>::SkipSpace(p, end);
+    }
+    const char* SkipSpace(const char* p, const char* end)
+    {
+        return Scanner<char>::SkipSpace(p, end);
+    }
+
+    const wchar_t* FindIdentEnd(const wchar_t* p, const wchar_t* end)
+    {
+        return Scanner<wchar_t>::FindIdentEnd(p, end);
+    }
+    const char* FindIdentEnd(const char* p, const char* end)
+    {
+        return Scanner<char>::FindIdentEnd(p, end);
+    }
+
+    const wchar_t* FindChar(const wchar_t* p, const wchar_t* end, wchar_t c)
+    {
+        return Scanner<wchar_t>::FindChar(p, end, c);
+    }
+    const char* FindChar(const char* p, const char* end, char c)
+    {
+        return Scanner<char>::FindChar(p, end, c);
+    }
+
+    size_t CountChar(const wchar_t* p, const wchar_t* end, wchar_t c)
+    {
+        return Scanner<wchar_t>::CountChar(p, end, c);
+    }
+    size_t CountChar(const char* p, const char* end, char c)
+    {
+        return Scanner<char>::CountChar(p, end, c);
+    }
+
+    size_t CountColumn(const wchar_t* p, const wchar_t* end)
+    {
+        return (size_t)(end - p);
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace jxcode::lexer
+{
+    //ASCII字符分类，非ASCII字符一律视为Word
+    enum CharClass : uint8_t
+    {
+        kCharSpace = 1 << 0,        // ' ' '\t' '\r'
+        kCharNumber = 1 << 1,
+        kCharSymbol = 1 << 2,
+        kCharControl = 1 << 3,
+        kCharLF = 1 << 4,
+        kCharIdentStop = 1 << 5,    //标识符结束：' ' '\r' '\n' '\0' 与符号
+    };
+
+    struct CharClassTable
+    {
+        uint8_t flags[128] = {};
+
+        constexpr CharClassTable()
+        {
+            for (int c = 0; c < 128; c++) {
+                uint8_t f = 0;
+                if (c == ' ' || c == '\t' || c == '\r')
+                    f |= kCharSpace;
+                if (c >= '0' && c <= '9')
+                    f |= kCharNumber;
+                if ((c >= 33 && c <= 47) || (c >= 58 && c <= 64) ||
+                    (c >= 91 && c <= 94) || (c == 96) || //95 = _
+                    (c >= 123 && c <= 126))
+                    f |= kCharSymbol;
+                if ((c >= 0 && c <= 31) || c == 127)
+                    f |= kCharControl;
+                if (c == '\n')
+                    f |= kCharLF;
+                if (c == ' ' || c == '\r' || c == '\n' || c == 0 || (f & kCharSymbol))
+                    f |= kCharIdentStop;
+                this->flags[c] = f;
+            }
+        }
+    };
+
+    inline constexpr CharClassTable char_class_table = CharClassTable();
+
+    inline constexpr uint8_t GetCharClass(wchar_t c)
+    {
+        return (c >= 0 && c < 128) ? char_class_table.flags[c] : (uint8_t)0;
+    }
+    //UTF-8多字节序列的每个字节都视为Word
+    inline constexpr uint8_t GetCharClass(char c)
+    {
+        return (unsigned char)c < 128 ? char_class_table.flags[(unsigned char)c] : (uint8_t)0;
+    }
+
+    //UTF-8后续字节（10xxxxxx），不单独占一列
+    inline constexpr bool IsUtf8Continuation(char c)
+    {
+        return ((unsigned char)c & 0xC0) == 0x80;
+    }
+    inline constexpr bool IsUtf8Continuation(wchar_t)
+    {
+        return false;
+    }
+
+    //批量扫描，[p, end)内返回第一个满足条件的位置，找不到返回end
+    //有SSE2/AVX2时按向量处理，否则逐字符查表
+    namespace charscan
+    {
+        //跳过 ' ' '\t' '\r'
+        const wchar_t* SkipSpace(const wchar_t* p, const wchar_t* end);
+        const char* SkipSpace(const char* p, const char* end);
+        //标识符结束位置
+        const wchar_t* FindIdentEnd(const wchar_t* p, const wchar_t* end);
+        const char* FindIdentEnd(const char* p, const char* end);
+        const wchar_t* FindChar(const wchar_t* p, const wchar_t* end, wchar_t c);
+        const char* FindChar(const char* p, const char* end, char c);
+        //统计[p, end)中c的数量，用于批量计算行号
+        size_t CountChar(const wchar_t* p, const wchar_t* end, wchar_t c);
+        size_t CountChar(const char* p, const char* end, char c);
+        //统计[p, end)中的字符数（UTF-8后续字节不计），用于批量计算列号
+        size_t CountColumn(const wchar_t* p, const wchar_t* end);
+        size_t CountColumn(const char* p, const char* end);
+        //当前编译使用的实现名称
+        const char* ImplName();
+    }
+}
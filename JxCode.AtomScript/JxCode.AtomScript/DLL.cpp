@@ -22,12 +22,17 @@ struct InterpreterState
     string serialize_data;
 
     LoadFileCallBack _loadfile;
+    LoadFileUtf8CallBack _loadfile_utf8;
+    ReadFileCallBack _readfile;
+    ReadFileUtf8CallBack _readfile_utf8;
+    ImagePathCallBack _imagepath;
     FunctionCallBack _funcall;
     ProgramEndingCallBack _end_;
 };
 
 map<int, InterpreterState*> g_inters;
 static int g_index = 0;
+static shared_ptr<ProgramCache> g_program_cache = make_shared<ProgramCache>();
 
 static void SetErrorMessage(int id, const wchar_t* str);
 
@@ -69,16 +74,18 @@ inline static Variable CheckAndGetVariable(int id, InterpreterState* inter, cons
 }
 
 
-inline static void SetTokenGroup(const vector<Token>& tokens, TokenGroup* group)
+//Token的值为源码视图，没有结尾的\0，需要复制到values中再传出
+inline static void SetTokenGroup(const vector<Token>& tokens, TokenGroup* group, wstring* values)
 {
     for (int i = 0; i < tokens.size(); i++)
     {
         const Token& token_item = tokens[i];
         TokenInfo& item = group->tokens[i];
         
+        values[i].assign(token_item.value);
         item.line = token_item.line;
         item.position = token_item.position;
-        item.value = token_item.value.get()->c_str();
+        item.value = values[i].c_str();
     }
     group->size = tokens.size();
 }
@@ -98,6 +105,33 @@ static wstring OnLoadFile(int id, const wstring& path)
     return inter->_loadfile(id, path.c_str());
 }
 
+static string OnLoadFileUtf8(int id, const wstring& path)
+{
+    auto inter = GetState(id);
+    return inter->_loadfile_utf8(id, path.c_str());
+}
+
+static size_t OnReadFile(int id, const wstring& path, size_t offset, wchar_t* buffer, size_t capacity)
+{
+    auto inter = GetState(id);
+    int count = inter->_readfile(id, path.c_str(), (int)offset, buffer, (int)capacity);
+    return count > 0 ? (size_t)count : 0;
+}
+
+static size_t OnReadFileUtf8(int id, const wstring& path, size_t offset, char* buffer, size_t capacity)
+{
+    auto inter = GetState(id);
+    int count = inter->_readfile_utf8(id, path.c_str(), (int)offset, buffer, (int)capacity);
+    return count > 0 ? (size_t)count : 0;
+}
+
+static wstring OnImagePath(int id, const wstring& path)
+{
+    auto inter = GetState(id);
+    const wchar_t* image_path = inter->_imagepath(id, path.c_str());
+    return image_path != nullptr ? wstring(image_path) : wstring();
+}
+
 static bool OnFuncall(int id,
     const intptr_t& user_type_id,
     const vector<Token>& domain,
@@ -110,13 +144,15 @@ static bool OnFuncall(int id,
 
     TokenGroup _domain;
     TokenInfo _domain_token_info[8];
+    wstring _domain_values[8];
     _domain.tokens = _domain_token_info;
-    SetTokenGroup(domain, &_domain);
+    SetTokenGroup(domain, &_domain, _domain_values);
 
     TokenGroup _path;
     TokenInfo _path_token_info[8];
+    wstring _path_values[8];
     _path.tokens = _path_token_info;
-    SetTokenGroup(path, &_path);
+    SetTokenGroup(path, &_path, _path_values);
     
     VariableGroup _var;
     Variable _var_infos[16];
@@ -184,6 +220,155 @@ int CALLAPI Initialize(int id, LoadFileCallBack _loadfile_, FunctionCallBack _fu
     return kSuccess;
 }
 
+int CALLAPI SetUtf8LoadFileCallBack(int id, LoadFileUtf8CallBack _loadfile_)
+{
+    auto inter = GetState(id);
+    if (inter == nullptr) {
+        return kNullResult;
+    }
+
+    inter->_loadfile_utf8 = _loadfile_;
+    if (_loadfile_ == nullptr) {
+        inter->interpreter->SetUtf8Loader(nullptr);
+    }
+    else {
+        inter->interpreter->SetUtf8Loader([id](const wstring& path)->string {
+            return OnLoadFileUtf8(id, path);
+        });
+    }
+    return kSuccess;
+}
+
+int CALLAPI SetReadFileCallBack(int id, ReadFileCallBack _readfile_)
+{
+    auto inter = GetState(id);
+    if (inter == nullptr) {
+        return kNullResult;
+    }
+
+    inter->_readfile = _readfile_;
+    if (_readfile_ == nullptr) {
+        inter->interpreter->SetStreamReader(nullptr);
+    }
+    else {
+        inter->interpreter->SetStreamReader([id](const wstring& path, size_t offset, wchar_t* buffer, size_t capacity)->size_t {
+            return OnReadFile(id, path, offset, buffer, capacity);
+        });
+    }
+    return kSuccess;
+}
+
+int CALLAPI SetUtf8ReadFileCallBack(int id, ReadFileUtf8CallBack _readfile_)
+{
+    auto inter = GetState(id);
+    if (inter == nullptr) {
+        return kNullResult;
+    }
+
+    inter->_readfile_utf8 = _readfile_;
+    if (_readfile_ == nullptr) {
+        inter->interpreter->SetUtf8StreamReader(nullptr);
+    }
+    else {
+        inter->interpreter->SetUtf8StreamReader([id](const wstring& path, size_t offset, char* buffer, size_t capacity)->size_t {
+            return OnReadFileUtf8(id, path, offset, buffer, capacity);
+        });
+    }
+    return kSuccess;
+}
+
+int CALLAPI SetImagePathCallBack(int id, ImagePathCallBack _imagepath_)
+{
+    auto inter = GetState(id);
+    if (inter == nullptr) {
+        return kNullResult;
+    }
+
+    inter->_imagepath = _imagepath_;
+    if (_imagepath_ == nullptr) {
+        inter->interpreter->SetImageLoader(nullptr);
+    }
+    else {
+        inter->interpreter->SetImageLoader([id](const wstring& path)->wstring {
+            return OnImagePath(id, path);
+        });
+    }
+    return kSuccess;
+}
+
+int CALLAPI SetProgramCache(int id, int enable)
+{
+    auto inter = GetState(id);
+    if (inter == nullptr) {
+        return kNullResult;
+    }
+
+    inter->interpreter->SetProgramCache(enable != 0 ? g_program_cache : nullptr);
+    return kSuccess;
+}
+
+void CALLAPI SetProgramCacheCapacity(int megabytes)
+{
+    g_program_cache->SetCapacity(megabytes > 0 ? (size_t)megabytes * 1024 * 1024 : 0);
+}
+
+void CALLAPI InvalidateProgramCache(const wchar_t* programName)
+{
+    if (programName == nullptr) {
+        g_program_cache->Clear();
+    }
+    else {
+        g_program_cache->Invalidate(programName);
+    }
+}
+
+int CALLAPI SetParallelLoad(int id, int enable, int thread_count)
+{
+    auto inter = GetState(id);
+    if (inter == nullptr) {
+        return kNullResult;
+    }
+
+    inter->interpreter->SetParallelLoad(enable != 0, thread_count > 0 ? (size_t)thread_count : 0);
+    return kSuccess;
+}
+
+int CALLAPI SetLazyLoad(int id, int enable)
+{
+    auto inter = GetState(id);
+    if (inter == nullptr) {
+        return kNullResult;
+    }
+
+    inter->interpreter->SetLazyLoad(enable != 0);
+    return kSuccess;
+}
+
+int CALLAPI SetOptimize(int id, int enable)
+{
+    auto inter = GetState(id);
+    if (inter == nullptr) {
+        return kNullResult;
+    }
+
+    inter->interpreter->SetOptimize(enable != 0);
+    return kSuccess;
+}
+
+int CALLAPI SetJit(int id, int enable)
+{
+    auto inter = GetState(id);
+    if (inter == nullptr) {
+        return kNullResult;
+    }
+
+    if (!inter->interpreter->SetJit(enable != 0)) {
+        SetErrorMessage(id, L"jit is not supported on this platform");
+        return kErrorMsg;
+    }
+    return kSuccess;
+}
+
 int CALLAPI ResetState(int id)
 {
     auto state = GetState(id);
@@ -231,6 +416,22 @@ int CALLAPI ExecuteProgram(int id, const wchar_t* file)
     return kSuccess;
 }
 
+int CALLAPI CompileProgramImage(int id, const wchar_t* file, const wchar_t* image_path)
+{
+    auto inter = CheckAndGetState(id);
+    if (inter == nullptr) {
+        return kNullResult;
+    }
+    try {
+        inter->interpreter->CompileImage(file, image_path);
+    }
+    catch (wexceptionbase& e) {
+        SetErrorMessage(id, e.what().c_str());
+        return kErrorMsg;
+    }
+    return kSuccess;
+}
+
 int CALLAPI Next(int id)
 {
     auto inter = CheckAndGetState(id);
@@ -361,8 +562,9 @@ int CALLAPI GetString(int id, int str_ptr, wchar_t* out_str)
         return kNullResult;
     }
     try {
-        wstring* str = inter->interpreter->GetString(str_ptr);
-        wcscpy(out_str, str->c_str());
+        wstring_view str = inter->interpreter->GetString(str_ptr);
+        str.copy(out_str, str.size());
+        out_str[str.size()] = L'\0';
     }
     catch (wexceptionbase& e) {
         SetErrorMessage(id, e.what().c_str());
@@ -378,7 +580,7 @@ int CALLAPI GetStringLength(int id, int str_ptr, int* out_length)
         return kNullResult;
     }
     try {
-        *out_length = inter->interpreter->GetString(str_ptr)->size() + 1;
+        *out_length = (int)inter->interpreter->GetString(str_ptr).size() + 1;
     }
     catch (wexceptionbase& e) {
         SetErrorMessage(id, e.what().c_str());
@@ -500,22 +702,22 @@ void CALLAPI GetLibVersion(wchar_t* out)
 #ifdef _WIN32
 
 BOOL APIENTRY DllMain(
-    HANDLE hModule,             // DLLģľ
-    DWORD ul_reason_for_call,   // ñԭ
-    LPVOID lpReserved           // 
+    HANDLE hModule,             // DLL模块的句柄
+    DWORD ul_reason_for_call,   // 调用本函数的原因
+    LPVOID lpReserved           // 保留
 ) {
     switch (ul_reason_for_call)
     {
-        case DLL_PROCESS_ATTACH: //ڼرDLL
+        case DLL_PROCESS_ATTACH: //进程正在加载本DLL
             break;
-        case DLL_THREAD_ATTACH://һ̱߳
+        case DLL_THREAD_ATTACH://一个线程被创建
             break;
-        case DLL_THREAD_DETACH://һ߳˳
+        case DLL_THREAD_DETACH://一个线程正常退出
             break;
-        case DLL_PROCESS_DETACH://жرDLL
+        case DLL_PROCESS_DETACH://进程正在卸载本DLL
             break;
     }
-    return TRUE;            //TRUE,ʾɹִб
+    return TRUE;            //返回TRUE,表示成功执行本函数
 }
 
 #endif
\ No newline at end of file
@@ -30,8 +30,15 @@ typedef struct
 } VariableGroup;
 
 typedef wchar_t* (*LoadFileCallBack)(int id, const wchar_t* path);
+//返回以'\0'结尾的UTF-8源码
+typedef char* (*LoadFileUtf8CallBack)(int id, const wchar_t* path);
+//分块读取：从offset处读取最多capacity个字符到buffer，返回读取的字符数，返回0表示结束
+typedef int(*ReadFileCallBack)(int id, const wchar_t* path, int offset, wchar_t* buffer, int capacity);
+typedef int(*ReadFileUtf8CallBack)(int id, const wchar_t* path, int offset, char* buffer, int capacity);
 typedef int(*FunctionCallBack)(int id, int user_ptr, TokenGroup domain, TokenGroup path, VariableGroup params);
 typedef void(*ProgramEndingCallBack)(int id, const wchar_t* programName);
+//返回程序的预编译文件路径，返回NULL或空字符串时从源码加载
+typedef const wchar_t* (*ImagePathCallBack)(int id, const wchar_t* programName);
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,6 +46,29 @@ extern "C" {
     DLLEXPORT void CALLAPI GetErrorMessage(int id, wchar_t* out_str);
     DLLEXPORT int CALLAPI NewInterpreter(int* id);
     DLLEXPORT int CALLAPI Initialize(int id, LoadFileCallBack _loadfile_, FunctionCallBack _funcall_, ProgramEndingCallBack _end_);
+    //设置后脚本以UTF-8读取并直接分析，传入NULL恢复使用LoadFileCallBack
+    DLLEXPORT int CALLAPI SetUtf8LoadFileCallBack(int id, LoadFileUtf8CallBack _loadfile_);
+    //设置后脚本分块读取并逐块解析，用于很大的脚本，传入NULL取消
+    DLLEXPORT int CALLAPI SetReadFileCallBack(int id, ReadFileCallBack _readfile_);
+    DLLEXPORT int CALLAPI SetUtf8ReadFileCallBack(int id, ReadFileUtf8CallBack _readfile_);
+    //设置后优先从预编译文件加载程序，传入NULL取消
+    DLLEXPORT int CALLAPI SetImagePathCallBack(int id, ImagePathCallBack _imagepath_);
+    //离线编译：读取脚本并写入预编译文件，不影响当前运行状态
+    DLLEXPORT int CALLAPI CompileProgramImage(int id, const wchar_t* file, const wchar_t* image_path);
+    //整体读取的脚本按程序名与内容共享编译结果，所有启用的解释器使用同一个缓存
+    DLLEXPORT int CALLAPI SetProgramCache(int id, int enable);
+    //缓存占用超过容量时淘汰最久未使用的程序
+    DLLEXPORT void CALLAPI SetProgramCacheCapacity(int megabytes);
+    //移除该程序的编译结果，传入NULL清空缓存
+    DLLEXPORT void CALLAPI InvalidateProgramCache(const wchar_t* programName);
+    //整体读取的脚本切分后多线程解析，thread_count为0时使用硬件线程数
+    DLLEXPORT int CALLAPI SetParallelLoad(int id, int enable, int thread_count);
+    //整体读取的脚本只预扫描标签，每块在第一次执行到时编译，标签需要位于行首
+    DLLEXPORT int CALLAPI SetLazyLoad(int id, int enable);
+    //加载时进行数据流优化
+    DLLEXPORT int CALLAPI SetOptimize(int id, int enable);
+    //热循环即时编译，只支持x86-64，不支持时返回错误并保持解释执行
+    DLLEXPORT int CALLAPI SetJit(int id, int enable);
 
     DLLEXPORT void CALLAPI Terminate(int id);
     DLLEXPORT int CALLAPI ResetState(int id);
@@ -1,9 +1,12 @@
 #include <stdexcept>
 #include "Interpreter.h"
+#include "StreamParser.h"
+#include "ParallelParser.h"
 #include "Lexer.h"
 #include <regex>
 #include <codecvt>
 #include <sstream>
+#include <set>
 #pragma warning(disable:4996)
 
 namespace jxcode::atomscript
@@ -18,64 +21,98 @@ namespace jxcode::atomscript
         return L"InterpreterException";
     }
 
-    InterpreterException::InterpreterException(const std::shared_ptr<Token>& token, const std::wstring& message)
+    InterpreterException::InterpreterException(const Token& token, const std::wstring& message)
         : TokenException(token, message)
     {
     }
 
     std::wstring InterpreterException::what()
     {
-        return this->message_ + L".  " + this->token_->to_string();
+        return this->message_ + L".  " + this->token_string_;
     }
 #pragma endregion
 
 
-    static map<wstring, vector<OpCommand>> op_cache = map<wstring, vector<OpCommand>>();
-
-    static bool exist_op_cache(const wstring& program_name)
-    {
-        return op_cache.count(program_name) > 0;
-    }
+    static constexpr OperatorDef atom_operator_defs[] = {
+        { L"==", TokenType::DoubleEqual },
+        { L"=", TokenType::Equal },
+        { L"(", TokenType::LBracket },
+        { L")", TokenType::RBracket },
+        { L"&&", TokenType::And },
+        { L"||", TokenType::Or },
+        { L"*", TokenType::Multiple },
+        { L"-", TokenType::Minus },
+        { L"+", TokenType::Plus },
+        { L"/", TokenType::Division },
+        { L"!=", TokenType::ExclamatoryAndEqual },
+        { L"::", TokenType::DoubleColon },
+        { L":", TokenType::Colon },
+        { L",", TokenType::Comma },
+        { L".", TokenType::Dot },
+
+        { L">", TokenType::GreaterThan },
+        { L">=", TokenType::GreaterThanEqual },
+        { L">>", TokenType::DoubleGreaterThan },
+        { L">>>", TokenType::TripleGreaterThan },
+        { L"<", TokenType::LessThan },
+        { L"<=", TokenType::LessThanEqual },
+        { L"<<", TokenType::DoubleLessThan },
+        { L"<<<", TokenType::TripleLessThan },
+
+        { L"~", TokenType::Tilde },
+        { L"!", TokenType::Exclamatory },
+        { L"@", TokenType::At },
+        { L"#", TokenType::Pound },
+        { L"$", TokenType::Doller },
+        { L"%", TokenType::Precent },
+
+        { L"?", TokenType::Question },
+
+        { L"->", TokenType::SingleArrow },
+        { L"=>", TokenType::DoubleArrow },
+
+        { L"call", TokenType::Call },
+        { L"goto", TokenType::Goto },
+        { L"if", TokenType::If },
+        { L"then", TokenType::Then },
+        { L"var", TokenType::Var },
+        { L"set", TokenType::Set },
+        { L"clearsub", TokenType::ClearSub },
+        { L"del", TokenType::Del },
+        { L"toprog", TokenType::ToProg },
+        { L"label", TokenType::Label },
+    };
+    //编译期生成的运算符表
+    static constexpr OperatorTable atom_operator_table(atom_operator_defs);
 
 
 #pragma region Interpreter
-    //ѹջΪstdcallʽҲʼѹջ
-    bool Interpreter::OnFunCall(const int32_t& user_ptr, const vector<Token>& domain, const vector<Token>& path, const vector<Variable>& params)
+    //压栈为stdcall方式，从右参数开始压栈
+    bool Interpreter::OnFunCall(const int32_t& user_ptr, const CallShape& call, const vector<Variable>& params)
     {
-        static wstring mathStr = L"math";
-        static wstring strlibStr = L"strlib";
-
-        stack<Variable> vars;
-
-        if (domain.size() == 1 && *domain[0].value == mathStr) {
-            const wstring& p = *path[0].value;
-
-            for (int i = (int)params.size() - 1; i >= 0; i--) {
-                vars.push(params[i]);
-            }
-
-            math_lib::Invoke(this, p, &vars);
-
-            if (!vars.empty()) {
-                this->SetReturnVariable(vars.top());
-            }
+        if (call.target == CallTarget::Host) {
+            return this->_funcall_(user_ptr, call.domain, call.path, params);
         }
-        else if (domain.size() == 1 && *domain[0].value == strlibStr) {
-            const wstring& p = *path[0].value;
 
-            for (int i = (int)params.size() - 1; i >= 0; i--) {
-                vars.push(params[i]);
-            }
-
-            strlib_lib::Invoke(this, p, &vars);
+        stack<Variable>& vars = this->call_stack_;
+        while (!vars.empty()) {
+            vars.pop();
+        }
+        for (int i = (int)params.size() - 1; i >= 0; i--) {
+            vars.push(params[i]);
+        }
 
-            if (!vars.empty()) {
-                this->SetReturnVariable(vars.top());
-            }
+        if (call.target == CallTarget::Math) {
+            math_lib::Invoke(this, call.function, &vars);
         }
         else {
-            return this->_funcall_(user_ptr, domain, path, params);
+            strlib_lib::Invoke(this, call.function, &vars);
+        }
+
+        if (!vars.empty()) {
+            this->SetReturnVariable(vars.top());
         }
+        return true;
     }
 
     int32_t Interpreter::line_num() const
@@ -84,240 +121,245 @@ namespace jxcode::atomscript
     }
     size_t Interpreter::opcmd_count() const
     {
-        return this->commands_->size();
+        //指令末尾有两条End
+        return this->program_->size() - 2;
     }
     const wstring& Interpreter::program_name() const
     {
         return this->program_name_;
     }
-    const map<wstring, Variable>& Interpreter::variables()
+    map<wstring, Variable, std::less<>> Interpreter::variables() const
     {
-        return this->variables_;
+        map<wstring, Variable, std::less<>> vars;
+        for (auto& item : this->symbols_.index()) {
+            const Variable& var = this->variables_[item.second];
+            if (var.type != VARIABLETYPE_UNDEFINED) {
+                vars.emplace(item.first, var);
+            }
+        }
+        return vars;
     }
-    const map<int32_t, wstring>& Interpreter::strpool()
+    const StringPool& Interpreter::strpool() const
     {
         return this->strpool_;
     }
     Interpreter::Interpreter(LoadFileCallBack _loadfile_, FuncallCallBack _funcall_, EndCallBack _end_)
-        : ptr_alloc_index_(0), is_end_(false), exec_ptr_(-1), _loadfile_(_loadfile_), _funcall_(_funcall_), _end_(_end_)
+        : is_end_(false), exec_ptr_(-1), _loadfile_(_loadfile_), _funcall_(_funcall_), _end_(_end_),
+        lexer_(atom_operator_table, lexer::get_std_esc_char_map()),
+        utf8_lexer_(atom_operator_table, lexer::get_std_esc_char_map()),
+        is_parallel_load_(false), parallel_thread_count_(0), is_optimize_(false), is_lazy_load_(false), gc_threshold_(kGCMinBytes)
     {
+        this->return_slot_ = this->VarSlot(L"__return");
     }
 
-    bool Interpreter::IsExistLabel(const wstring& label)
+    void Interpreter::SetUtf8Loader(LoadFileUtf8CallBack _loadfile_utf8_)
     {
-        return this->labels_.find(label) != this->labels_.end();
+        this->_loadfile_utf8_ = _loadfile_utf8_;
     }
 
-    void Interpreter::SetVar(const wstring& name, const float& num)
+    void Interpreter::SetStreamReader(ReadFileCallBack _readfile_)
     {
-        Variable var = this->GetVar(name);
-        if (var.type == VARIABLETYPE_UNDEFINED) {
-            SetVariableNumber(&var, num);
-            this->variables_[name] = var;
+        this->_readfile_ = _readfile_;
+    }
+
+    void Interpreter::SetUtf8StreamReader(ReadFileUtf8CallBack _readfile_utf8_)
+    {
+        this->_readfile_utf8_ = _readfile_utf8_;
+    }
+
+    void Interpreter::SetImageLoader(ImagePathCallBack _imagepath_)
+    {
+        this->_imagepath_ = _imagepath_;
+    }
+
+    void Interpreter::SetProgramCache(const shared_ptr<ProgramCache>& cache)
+    {
+        this->cache_ = cache;
+    }
+
+    void Interpreter::SetParallelLoad(bool enable, size_t thread_count)
+    {
+        this->is_parallel_load_ = enable;
+        this->parallel_thread_count_ = thread_count;
+    }
+
+    void Interpreter::SetLazyLoad(bool enable)
+    {
+        this->is_lazy_load_ = enable;
+    }
+
+    void Interpreter::SetOptimize(bool enable)
+    {
+        this->is_optimize_ = enable;
+    }
+
+    bool Interpreter::SetJit(bool enable)
+    {
+        if (!enable || !LoopJit::IsSupported()) {
+            this->jit_.reset();
+            return !enable;
         }
-        else {
-            SetVariableNumber(&this->variables_[name], num);
+        if (!this->jit_) {
+            this->jit_ = std::make_unique<LoopJit>(this->return_slot_);
         }
+        return true;
     }
 
-    void Interpreter::SetVar(const wstring& name, const wstring& str)
+    bool Interpreter::IsExistLabel(wstring_view label)
     {
-        Variable var = this->GetVar(name);
-        if (var.type == VARIABLETYPE_UNDEFINED) {
-            this->variables_[name] = var;
+        return this->labels_.find(wstring(label)) != this->labels_.end();
+    }
+
+    int32_t Interpreter::VarSlot(wstring_view name)
+    {
+        int32_t slot = this->symbols_.Intern(name);
+        if (slot >= (int32_t)this->variables_.size()) {
+            Variable var;
+            SetVariableUndefined(&var);
+            this->variables_.resize(this->symbols_.size(), var);
         }
+        return slot;
+    }
+
+    void Interpreter::SetVar(wstring_view name, const float& num)
+    {
+        SetVariableNumber(&this->variables_[this->VarSlot(name)], num);
+    }
+
+    void Interpreter::SetVar(wstring_view name, wstring_view str)
+    {
+        int32_t slot = this->VarSlot(name);
         int id = this->NewStrPtr(str);
-        SetVariableStrPtr(&this->variables_[name], id);
+        SetVariableStrPtr(&this->variables_[slot], id);
     }
 
-    void Interpreter::SetVar(const wstring& name, const int& user_id)
+    void Interpreter::SetVar(wstring_view name, const int& user_id)
     {
-        Variable var = this->GetVar(name);
-        if (var.type == VARIABLETYPE_UNDEFINED) {
-            this->variables_[name] = var;
-        }
-        SetVariableUserPtr(&this->variables_[name], user_id);
+        SetVariableUserPtr(&this->variables_[this->VarSlot(name)], user_id);
     }
 
-    void Interpreter::SetVar(const wstring& name, const Variable& _var)
+    void Interpreter::SetVar(wstring_view name, const Variable& _var)
     {
         if (_var.type == VARIABLETYPE_UNDEFINED) {
             return;
         }
-        this->variables_[name] = _var;
+        this->variables_[this->VarSlot(name)] = _var;
     }
 
-    void Interpreter::DelVar(const wstring& name)
+    void Interpreter::DelVar(wstring_view name)
     {
-        auto it = this->variables_.find(name);
-        if (it != this->variables_.end()) {
-            this->variables_.erase(it);
+        int32_t slot = this->symbols_.Find(name);
+        if (slot >= 0) {
+            SetVariableUndefined(&this->variables_[slot]);
         }
     }
 
-    Variable Interpreter::GetVar(const wstring& name)
+    Variable Interpreter::GetVar(wstring_view name)
     {
-        auto it = this->variables_.find(name);
-        if (it == this->variables_.end()) {
+        int32_t slot = this->symbols_.Find(name);
+        if (slot < 0) {
             Variable var;
             SetVariableUndefined(&var);
             return var;
         }
-        return it->second;
+        return this->variables_[slot];
     }
 
-    int Interpreter::GetStrPtr(const wstring& str)
+    int Interpreter::GetStrPtr(wstring_view str)
     {
-        int id = 0;
-        for (auto& item : this->strpool_) {
-            if (item.second == str) {
-                id = item.first;
-            }
-        }
-        return id;
+        return this->strpool_.Find(str);
     }
 
-    int Interpreter::NewStrPtr(const wstring& str)
+    int Interpreter::NewStrPtr(wstring_view str)
     {
-        int _id = this->GetStrPtr(str);
-        if (_id != 0) {
-            return _id;
-        }
-
-        ++this->ptr_alloc_index_;
-
-        this->strpool_[this->ptr_alloc_index_] = str;
-        return this->ptr_alloc_index_;
+        return this->strpool_.Intern(str);
     }
 
-    wstring* Interpreter::GetString(const int& strptr)
+    int Interpreter::CatStrPtr(const int& strptr1, const int& strptr2)
     {
-        return &this->strpool_[strptr];
-    }
-    void Interpreter::GCollect()
-    {
-        //ûгַʱַ
-        vector<int> delay_remove_list;
-        for (auto& item : this->strpool_) {
-            bool has_var = false;
-            for (auto& var_item : this->variables_) {
-                const Variable& var = var_item.second;
-                if (var.type == VARIABLETYPE_STRPTR && var.ptr == item.first) {
-                    has_var = true;
-                    break;
-                }
-            }
-            if (!has_var) {
-                delay_remove_list.push_back(item.first);
-            }
-        }
-        for (auto& item : delay_remove_list) {
-            this->strpool_.erase(item);
-        }
+        return this->strpool_.Append(strptr1, this->strpool_.View(strptr2));
     }
 
-    void Interpreter::SetReturnVariable(const Variable& var)
+    wstring_view Interpreter::GetString(const int& strptr)
     {
-        this->SetVar(L"__return", var);
-    }
-
-    inline static bool IsLiteralToken(const shared_ptr<Token>& token) {
-        return token->token_type == TokenType::Number || token->token_type == TokenType::String;
+        return this->strpool_.Get(strptr);
     }
-    inline static bool IsLiteralOrVarStrToken(Interpreter* inter, const shared_ptr<Token>& token) {
-        if (token->token_type == TokenType::String) {
-            return true;
-        }
-        if (token->token_type == TokenType::Ident) {
-            auto var = inter->GetVar(*token->value);
+    void Interpreter::MarkStrings()
+    {
+        //变量中没有持有引用的字符串会被销毁
+        this->strpool_.BeginCollect();
+        for (const Variable& var : this->variables_) {
             if (var.type == VARIABLETYPE_STRPTR) {
-                return true;
+                this->strpool_.Mark(var.ptr);
             }
         }
-        return false;
     }
 
-    inline static void CheckValidLength(const OpCommand& cmd, int length) {
-        auto size = cmd.targets.size();
-        if (size != length) {
-            throw InterpreterException(cmd.op_token, L"arguments error");
-        }
-    }
-    inline static void CheckValidMinLength(const OpCommand& cmd, int min_length) {
-        auto size = cmd.targets.size();
-        if (size < min_length) {
-            throw InterpreterException(cmd.op_token, L"arguments error");
+    void Interpreter::PinLiterals(size_t first)
+    {
+        const auto& strings = this->program_->strings;
+        this->literal_ptrs_.resize(strings.size());
+        for (size_t i = first; i < strings.size(); i++) {
+            this->literal_ptrs_[i] = this->strpool_.Pin(strings[i]);
         }
     }
-    inline static void CheckValidIdent(const shared_ptr<Token>& token) {
-        if (token->token_type != TokenType::Ident) {
-            throw InterpreterException(token, L"argument not is ident");
-        }
+
+    void Interpreter::GCollect()
+    {
+        this->MarkStrings();
+        this->strpool_.Sweep(SIZE_MAX);
+        this->gc_threshold_ = (std::max)(kGCMinBytes, this->strpool_.live_bytes());
     }
-    inline static void CheckValidTokenType(const shared_ptr<Token>& token, const TokenType& type) {
-        if (token->token_type != type) {
-            throw InterpreterException(token, L"token type error");
+
+    void Interpreter::GCStep()
+    {
+        if (!this->strpool_.is_sweeping()) {
+            this->MarkStrings();
         }
-    }
-    inline static void CheckValidStrVarOrStrLiteral(Interpreter* inter, const shared_ptr<Token>& token) {
-        if (!IsLiteralOrVarStrToken(inter, token)) {
-            throw InterpreterException(token, L"type error");
+        if (this->strpool_.Sweep(kGCSweepStep)) {
+            this->gc_threshold_ = (std::max)(kGCMinBytes, this->strpool_.live_bytes());
         }
     }
-    inline static void CheckValidVariable(Interpreter* inter, const shared_ptr<Token>& token) {
-        auto var = inter->GetVar(*token->value);
+
+    void Interpreter::SetReturnVariable(const Variable& var)
+    {
         if (var.type == VARIABLETYPE_UNDEFINED) {
-            throw InterpreterException(token, L"variable undefined");
+            return;
         }
+        this->variables_[this->return_slot_] = var;
     }
-    inline static void CheckValidVariableOrLiteral(Interpreter* inter, const shared_ptr<Token>& token) {
-        //ֵ  
-        if (!IsLiteralToken(token)
-            && inter->GetVar(*token->value).type == VARIABLETYPE_UNDEFINED)
-        {
-            throw InterpreterException(token, L"variable undefined");
-        }
+
+    inline static float ToNumber(wstring_view str) {
+        return stof(wstring(str));
     }
-    inline static void CheckValidVariableType(const shared_ptr<Token>& token, const Variable& var, int type) {
+
+    inline static void CheckValidVariableType(const Token& token, const Variable& var, int type) {
         if (var.type != type) {
             throw InterpreterException(token, L"variable type error");
         }
     }
 
     inline static bool NumberOperate(TokenType eqtype, const Variable& x, const Variable& y) {
-        if (eqtype == TokenType::DoubleEqual) {
-            return x.num == y.num;
-        }
-        else if (eqtype == TokenType::ExclamatoryAndEqual) {
-            return x.num != y.num;
-        }
-        else if (eqtype == TokenType::GreaterThan) {
-            return x.num > y.num;
-        }
-        else if (eqtype == TokenType::GreaterThanEqual) {
-            return x.num >= y.num;
-        }
-        else if (eqtype == TokenType::LessThan) {
-            return x.num < y.num;
+        return NumberCompare(eqtype, x.num, y.num);
+    }
+    //池中内容相同的字符串只有一个指针，只有拼接的字符串（负的指针）或恢复的快照中有重复内容时才需要比较内容
+    inline static bool IsStringEqual(Interpreter* inter, int32_t x, int32_t y) {
+        if (x == y) {
+            return true;
         }
-        else if (eqtype == TokenType::LessThanEqual) {
-            return x.num <= y.num;
+        if ((x | y) >= 0 && inter->strpool().is_unique()) {
+            return false;
         }
-        return false;
+        return inter->strpool().Equals(x, y);
     }
+
     inline static bool StrptrOperate(Interpreter* inter, TokenType eqtype, const Variable& x, const Variable& y) {
 
         if (eqtype == TokenType::DoubleEqual) {
-            if (x.ptr == y.ptr) {
-                return true;
-            }
-            return *inter->GetString(x.ptr) == *inter->GetString(y.ptr);
+            return IsStringEqual(inter, x.ptr, y.ptr);
         }
         else if (eqtype == TokenType::ExclamatoryAndEqual) {
-            if (x.ptr != y.ptr) {
-                return true;
-            }
-            return *inter->GetString(x.ptr) != *inter->GetString(y.ptr);
+            return !IsStringEqual(inter, x.ptr, y.ptr);
         }
         return false;
     }
@@ -345,252 +387,213 @@ namespace jxcode::atomscript
         return false;
     }
 
+    //数字字面值或数字变量
+    inline static bool LoadNumber(const Variable* vars, const Operand& op, float* out) {
+        if (op.kind == OperandKind::Number) {
+            *out = op.num;
+            return true;
+        }
+        if (op.kind == OperandKind::Ident && vars[op.slot].type == VARIABLETYPE_NUMBER) {
+            *out = vars[op.slot].num;
+            return true;
+        }
+        return false;
+    }
+
+    //按第一次执行时的操作数类型把比较改写为快速指令
+    inline static void QuickenCompare(Instruction* ins, InstrCode num_code, InstrCode str_code, const Variable& x, const Variable& y) {
+        if (ins->is_unstable) {
+            return;
+        }
+        bool is_operand_num = ins->x.kind != OperandKind::NumberText && ins->y.kind != OperandKind::NumberText;
+        if (x.type == VARIABLETYPE_NUMBER && y.type == VARIABLETYPE_NUMBER && is_operand_num) {
+            ins->code = num_code;
+            return;
+        }
+        if (x.type != VARIABLETYPE_STRPTR || y.type != VARIABLETYPE_STRPTR || ins->x.kind != OperandKind::Ident) {
+            return;
+        }
+        //变量与字符串字面值的不等比较保持通用指令，见IfGotoStr
+        if ((ins->y.kind == OperandKind::Ident && ins->compare == TokenType::ExclamatoryAndEqual)
+            || ins->compare == TokenType::DoubleEqual) {
+            ins->code = str_code;
+        }
+    }
+
+    //字符串快速比较，变量不是字符串时返回false
+    inline static bool CompareStrPtr(Interpreter* inter, const int32_t* literals, const Variable* vars, const Instruction& ins, bool* result) {
+        const Variable& x = vars[ins.x.slot];
+        if (x.type != VARIABLETYPE_STRPTR) {
+            return false;
+        }
+        if (ins.y.kind == OperandKind::String) {
+            *result = IsStringEqual(inter, x.ptr, literals[ins.y.str]);
+            return true;
+        }
+        const Variable& y = vars[ins.y.slot];
+        if (y.type != VARIABLETYPE_STRPTR) {
+            return false;
+        }
+        *result = StrptrOperate(inter, ins.compare, x, y);
+        return true;
+    }
+
     void Interpreter::ResetState()
     {
-        // ִָ룬ǩ
+        //清除 命令集，命令集执行指针，标签集
         decltype(this->commands_)().swap(this->commands_);
+        decltype(this->tokens_)().swap(this->tokens_);
+        decltype(this->image_)().swap(this->image_);
+        decltype(this->compiled_)().swap(this->compiled_);
+        this->lazy_.reset();
+        if (this->jit_) {
+            this->jit_->Clear();
+        }
+        for (int32_t ptr : this->literal_ptrs_) {
+            this->strpool_.Unpin(ptr);
+        }
+        this->literal_ptrs_.clear();
+        decltype(this->program_)().swap(this->program_);
         this->exec_ptr_ = -1;
         decltype(this->labels_)().swap(this->labels_);
         this->program_name_.clear();
     }
 
 
-    bool Interpreter::ExecuteLine(const OpCommand& cmd)
+    bool Interpreter::ExecuteCall(const CallSite& site)
     {
-        if (cmd.code == OpCode::Unknow) {
-            throw InterpreterException(cmd.op_token, L"unknow opcode");
+        Variable var = this->variables_[site.object_slot];
+        const CallShape* call = &site.static_call;
+        int32_t var_userptr = 0;
+
+        //instance
+        if (var.type != VARIABLETYPE_UNDEFINED) {
+            CheckValidVariableType(*site.object_token, var, VARIABLETYPE_USERPTR);
+            var_userptr = var.ptr;
+            call = &site.instance_call;
         }
-        else if (cmd.code == OpCode::Call) {
-            //
-            Variable var = this->GetVar(*cmd.targets[0]->value);
-
-            vector<Token> domain;
-            vector<Token> path;
-            vector<Variable> params;
-
-            int var_userptr = 0;
-
-            int32_t index = 0;
-
-            //instance
-            if (var.type != VARIABLETYPE_UNDEFINED) {
-                CheckValidVariableType(cmd.targets[0], var, VARIABLETYPE_USERPTR);
-                var_userptr = var.ptr;
-                index = 1;
-            }
-
-            bool is_symbol = false;
-            bool is_last_domain = false;
-            bool is_last_path = false;
-
-            if (var.type != VARIABLETYPE_UNDEFINED) {
-                is_symbol = true; //һʲô
-                //is_last_path = true; //ֱӻȡӶ
-            }
-            else {
-                is_last_domain = true; //̬Ӷʼ
-            }
-
-            for (; index < cmd.targets.size(); index++) {
-                auto token = cmd.targets[index];
-
-                if (is_symbol) {
-                    if (token->token_type == TokenType::DoubleColon) {
-                        //
-                        is_last_domain = true;
-                    }
-                    else if (token->token_type == TokenType::Dot) {
-                        //Ӷ
-                        is_last_path = true;
-                    }
-                    else if (token->token_type == TokenType::Colon) {
-                        //˳
-                        index++;
-                        break;
-                    }
-                    else {
-                        throw InterpreterException(token, L"parser error");
-                    }
-                    is_symbol = false;
-                }
-                else {
-                    if (is_last_domain) {
-                        domain.push_back(*cmd.targets[index]);
-                        is_last_domain = false;
-                    }
-                    if (is_last_path) {
-                        path.push_back(*cmd.targets[index]);
-                        is_last_path = false;
-                    }
-
-                    is_symbol = true;
-                }
-            }
-
-            bool shouldBeComma = false;
-
-            for (; index < cmd.targets.size(); index++) {
-                auto token = cmd.targets[index];
-
-                Variable temp_var;
-
-                //ֱʡԶ
-                if (token->token_type == TokenType::Comma) {
-                    //ǶֱӺ
-                    if (shouldBeComma) {
-                        shouldBeComma = false;
-                        continue;
-                    }
-                    //ǶŵӦǶţòʡ
-                    SetVariableUndefined(&temp_var);
-                    shouldBeComma = false;
-                }
-                else {
-                    //ȡ
-                    CheckValidVariableOrLiteral(this, token);
-                    if (IsLiteralToken(token)) {
-                        if (token->token_type == TokenType::Number) {
-                            SetVariableNumber(&temp_var, stof(*token->value));
-                        }
-                        else if (token->token_type == TokenType::String) {
-                            auto strptr = this->NewStrPtr(*token->value);
-                            SetVariableStrPtr(&temp_var, strptr);
-                        }
-                    }
-                    else {
-                        temp_var = this->GetVar(*token->value);
-                    }
-                    shouldBeComma = true;
-                }
-
-                params.push_back(temp_var);
-
-            }
-
-            return this->OnFunCall(var_userptr, domain, path, params);
-            //return this->_funcall_(var_userptr, domain, path, params);
-        }
-        else if (cmd.code == OpCode::Label) {
-            //ignore;
+        if (call->error != nullptr) {
+            throw InterpreterException(*call->error, L"parser error");
         }
-        else if (cmd.code == OpCode::If) {
 
-            Variable x = this->GenTempVar(cmd.targets[0]);
-            Variable y = this->GenTempVar(cmd.targets[2]);
-
-            bool _success = VariableOperate(this, cmd.targets[1]->token_type, x, y);
-            //ɹһ
-            if (!_success) {
-                ++this->exec_ptr_;
+        //参数缓冲区复用，不在每次调用时分配
+        vector<Variable>& params = this->call_params_;
+        params.clear();
+        for (const Operand& arg : call->args) {
+            Variable temp_var = this->GenTempVar(arg);
+            if (arg.kind == OperandKind::Ident && temp_var.type == VARIABLETYPE_UNDEFINED) {
+                throw InterpreterException(*arg.token, L"variable undefined");
             }
+            params.push_back(temp_var);
         }
-        else if (cmd.code == OpCode::Goto) {
-
-            wstring* label = nullptr;
 
-            if (cmd.targets.size() == 1) {
-                label = cmd.targets[0]->value.get();
-            }
-            else if (cmd.targets.size() == 2) {
-                Variable var = this->GetVar(*cmd.targets[1]->value);
-                label = this->GetString(var.ptr);
-            }
-            else {
-                throw InterpreterException(cmd.op_token, L"goto");
-            }
+        return this->OnFunCall(var_userptr, *call, params);
+    }
 
-            //Check
-            if (!this->IsExistLabel(*label)) {
-                throw InterpreterException(cmd.op_token, L"Label not found.");
-            }
-            //jump
-            int32_t pos = (int32_t)this->labels_[*label];
-            this->exec_ptr_ = pos;
+    int32_t Interpreter::FindLabel(Instruction* goto_var)
+    {
+        const Variable& var = this->variables_[goto_var->x.slot];
+        //字符串指针在重置内存前不会指向其他字符串，与上次相同时直接使用上次的结果
+        if (var.type == VARIABLETYPE_STRPTR && var.ptr == goto_var->label_ptr && var.ptr != 0) {
+            return goto_var->jump;
         }
-        else if (cmd.code == OpCode::Set) {
-            //ʱñʽֻʹһֵ ʱ
-            CheckValidLength(cmd, 3);
-            CheckValidIdent(cmd.targets[0]);
-            CheckValidTokenType(cmd.targets[1], TokenType::Equal);
-
-            wstring& varname = *cmd.targets[0]->value;
 
-            if (cmd.targets[2]->token_type == TokenType::Number) {
-                this->SetVar(varname, std::stof(*cmd.targets[2]->value));
-            }
-            else if (cmd.targets[2]->token_type == TokenType::String)
-            {
-                this->SetVar(varname, *cmd.targets[2]->value);
-            }
-            else if (cmd.targets[2]->token_type == TokenType::Ident) {
-                Variable v = this->GetVar(*cmd.targets[2]->value);
-                if (v.type == VARIABLETYPE_UNDEFINED) {
-                    throw InterpreterException(cmd.targets[2], L"variable not found");
+        wstring_view label = this->GetString(var.ptr);
+        //拼接生成的字符串内容相同时指针也可能不同，内容与上次的标签名相同时也可以使用上次的结果
+        //上次的目标不是带标签名的label命令时按标签集查找
+        if (goto_var->jump >= 0) {
+            const OpCommand* target = this->program_->code[goto_var->jump].cmd;
+            if (target != nullptr && target->code == OpCode::Label && !target->targets.empty()
+                && target->targets[0].value == label) {
+                if (var.type == VARIABLETYPE_STRPTR) {
+                    goto_var->label_ptr = var.ptr;
                 }
-                this->SetVar(varname, v);
+                return goto_var->jump;
             }
         }
-        else if (cmd.code == OpCode::Del) {
-            CheckValidLength(cmd, 1);
-            CheckValidIdent(cmd.targets[0]);
-            this->DelVar(*cmd.targets[0]->value);
+        auto it = this->labels_.find(wstring(label));
+        if (it == this->labels_.end()) {
+            throw InterpreterException(goto_var->cmd->op_token, L"Label not found.");
+        }
+        if (var.type == VARIABLETYPE_STRPTR) {
+            goto_var->label_ptr = var.ptr;
+            goto_var->jump = (int32_t)it->second;
         }
-        else if (cmd.code == OpCode::ToProg) {
-            wstring* pfilestr;
-            CheckValidLength(cmd, 1);
-            auto token = cmd.targets[0];
-            CheckValidStrVarOrStrLiteral(this, token);
+        return (int32_t)it->second;
+    }
 
-            if (token->token_type == TokenType::Ident) {
-                auto var = this->GetVar(*token->value);
-                pfilestr = this->GetString(var.ptr);
+    //低频指令，其余指令在Next的分派循环中直接执行
+    void Interpreter::ExecuteInstruction(const Instruction& ins)
+    {
+        switch (ins.code)
+        {
+        case InstrCode::Del:
+            SetVariableUndefined(&this->variables_[ins.x.slot]);
+            break;
+        case InstrCode::ToProg:
+        {
+            wstring filestr;
+            if (ins.x.kind == OperandKind::Ident) {
+                const Variable& var = this->variables_[ins.x.slot];
+                if (var.type != VARIABLETYPE_STRPTR) {
+                    throw InterpreterException(*ins.x.token, L"type error");
+                }
+                filestr = this->GetString(var.ptr);
             }
             else {
-                pfilestr = token->value.get();
+                filestr = this->program_->strings[ins.x.str];
             }
-            this->ExecuteProgram(*pfilestr);
+            //ExecuteProgram会释放当前程序，ins之后不再有效
+            this->ExecuteProgram(filestr);
+            break;
         }
-        else if (cmd.code == OpCode::ClearSub) {
-            //ӱ
-            //ӱObj__subvar
-            CheckValidLength(cmd, 1);
-            CheckValidIdent(cmd.targets[0]);
-
-            auto target = cmd.targets[0]->value;
-
-            auto it = this->variables_.begin();
-            while (it != this->variables_.end()) {
-                wstring name = it->first;
-                if (name.length() > target->length() + 2 && name.substr(0, target->length() + 2) == *target + L"__") {
-                    this->variables_.erase(it++);
+        case InstrCode::ClearSub:
+        {
+            //清理子变量
+            //子变量规则，Obj__subvar
+            wstring prefix = wstring(ins.x.token->value) + L"__";
+
+            //符号表按名字排序，前缀相同的变量连续排列
+            auto& index = this->symbols_.index();
+            for (auto it = index.lower_bound(prefix); it != index.end(); ++it) {
+                const wstring& name = it->first;
+                if (name.compare(0, prefix.length(), prefix) != 0) {
+                    break;
                 }
-                else {
-                    it++;
+                if (name.length() > prefix.length()) {
+                    SetVariableUndefined(&this->variables_[it->second]);
                 }
             }
+            break;
+        }
+        case InstrCode::Error:
+            throw InterpreterException(*ins.x.token, ins.error);
+        default:
+            break;
         }
-
-        return true;
     }
 
-    Variable Interpreter::GenTempVar(const std::shared_ptr<Token>& token)
+    Variable Interpreter::GenTempVar(const Operand& op)
     {
-        //бֱӷ
-        Variable v = this->GetVar(*token->value);
-        if (v.type != VARIABLETYPE_UNDEFINED) {
-            return v;
-        }
-
-        if (token->token_type == TokenType::Number) {
-            v = this->GenTempVar(stof(*token->value));
-        }
-        else if (token->token_type == TokenType::String) {
-            v = this->GenTempVar(*token->value);
-        }
-        else {
+        Variable v;
+        switch (op.kind)
+        {
+        case OperandKind::Number:
+            SetVariableNumber(&v, op.num);
+            break;
+        case OperandKind::NumberText:
+            SetVariableNumber(&v, ToNumber(op.token->value));
+            break;
+        case OperandKind::String:
+            SetVariableStrPtr(&v, this->literal_ptrs_[op.str]);
+            break;
+        case OperandKind::Ident:
+            v = this->variables_[op.slot];
+            break;
+        default:
             SetVariableUndefined(&v);
+            break;
         }
-
         return v;
     }
 
@@ -601,7 +604,7 @@ namespace jxcode::atomscript
         return v;
     }
 
-    Variable Interpreter::GenTempVar(const wstring& str)
+    Variable Interpreter::GenTempVar(wstring_view str)
     {
         int strptr = this->NewStrPtr(str);
         Variable v;
@@ -609,46 +612,85 @@ namespace jxcode::atomscript
         return v;
     }
 
-    static map<wstring, TokenType> get_atom_operator_map() {
-        map<wstring, TokenType> mp;
-        mp[L"=="] = TokenType::DoubleEqual;
-        mp[L"="] = TokenType::Equal;
-        mp[L"("] = TokenType::LBracket;
-        mp[L")"] = TokenType::RBracket;
-        mp[L"&&"] = TokenType::And;
-        mp[L"||"] = TokenType::Or;
-        mp[L"*"] = TokenType::Multiple;
-        mp[L"-"] = TokenType::Minus;
-        mp[L"+"] = TokenType::Plus;
-        mp[L"/"] = TokenType::Division;
-        mp[L"!="] = TokenType::ExclamatoryAndEqual;
-        mp[L"::"] = TokenType::DoubleColon;
-        mp[L":"] = TokenType::Colon;
-        mp[L","] = TokenType::Comma;
-        mp[L"."] = TokenType::Dot;
-
-        mp[L">"] = TokenType::GreaterThan;
-        mp[L">="] = TokenType::GreaterThanEqual;
-        mp[L">>"] = TokenType::DoubleGreaterThan;
-        mp[L">>>"] = TokenType::TripleGreaterThan;
-        mp[L"<"] = TokenType::LessThan;
-        mp[L"<="] = TokenType::LessThanEqual;
-        mp[L"<<"] = TokenType::DoubleLessThan;
-        mp[L"<<<"] = TokenType::TripleLessThan;
-
-        mp[L"~"] = TokenType::Tilde;
-        mp[L"!"] = TokenType::Exclamatory;
-        mp[L"@"] = TokenType::At;
-        mp[L"#"] = TokenType::Pound;
-        mp[L"$"] = TokenType::Doller;
-        mp[L"%"] = TokenType::Precent;
-
-        mp[L"?"] = TokenType::Question;
-
-        mp[L"->"] = TokenType::SingleArrow;
-        mp[L"=>"] = TokenType::DoubleArrow;
-
-        return mp;
+    void Interpreter::ParseSource(const wstring& program_name, shared_ptr<lexer::TokenList>* tokens, shared_ptr<CommandList>* commands)
+    {
+        //解析器只在解析期间引用名字
+        wstring name = program_name;
+
+        if (this->_readfile_utf8_ || this->_readfile_) {
+            //分块读取，命令Token引用tokens中的驻留字符串
+            *tokens = std::make_shared<lexer::TokenList>();
+            *commands = std::make_shared<CommandList>();
+            if (this->_readfile_utf8_) {
+                Utf8StreamParser parser(&this->utf8_lexer_,
+                    [this, &program_name](size_t offset, char* buffer, size_t capacity) {
+                        return this->_readfile_utf8_(program_name, offset, buffer, capacity);
+                    },
+                    tokens->get(), &name);
+                while (parser.ParseNext(commands->get()));
+            }
+            else {
+                StreamParser parser(&this->lexer_,
+                    [this, &program_name](size_t offset, wchar_t* buffer, size_t capacity) {
+                        return this->_readfile_(program_name, offset, buffer, capacity);
+                    },
+                    tokens->get(), &name);
+                while (parser.ParseNext(commands->get()));
+            }
+        }
+        else if (this->_loadfile_utf8_) {
+            auto code = std::make_shared<const string>(this->_loadfile_utf8_(program_name));
+            this->ParseCode(name, code, tokens, commands);
+        }
+        else {
+            auto code = std::make_shared<const wstring>(this->_loadfile_(program_name));
+            this->ParseCode(name, code, tokens, commands);
+        }
+    }
+
+    void Interpreter::ParseCode(const wstring& program_name, const shared_ptr<const string>& code, shared_ptr<lexer::TokenList>* tokens, shared_ptr<CommandList>* commands)
+    {
+        wstring name = program_name;
+        if (this->is_parallel_load_) {
+            //切分后多线程解析，标签在拼接完成后统一收集，下标即为全局下标
+            *tokens = std::make_shared<lexer::TokenList>();
+            *commands = std::make_shared<CommandList>();
+            Utf8ParallelParser parser(&this->utf8_lexer_, &name, this->parallel_thread_count_);
+            parser.Parse(code, tokens->get(), commands->get());
+        }
+        else {
+            //直接分析UTF-8源码，只有Token的值会转为宽字符，源码在分析后释放
+            *tokens = std::make_shared<lexer::TokenList>(lexer::WidenTokenList(this->utf8_lexer_.Scan(code)));
+            *commands = ParseOpList(&name, tokens->get());
+        }
+    }
+
+    void Interpreter::ParseCode(const wstring& program_name, const shared_ptr<const wstring>& code, shared_ptr<lexer::TokenList>* tokens, shared_ptr<CommandList>* commands)
+    {
+        wstring name = program_name;
+        if (this->is_parallel_load_) {
+            *tokens = std::make_shared<lexer::TokenList>();
+            *commands = std::make_shared<CommandList>();
+            ParallelParser parser(&this->lexer_, &name, this->parallel_thread_count_);
+            parser.Parse(code, tokens->get(), commands->get());
+        }
+        else {
+            *tokens = std::make_shared<lexer::TokenList>(this->lexer_.Scan(code));
+            *commands = ParseOpList(&name, tokens->get());
+        }
+    }
+
+    //获取所有标签
+    static LabelMap CollectLabels(const CommandList& commands)
+    {
+        LabelMap labels;
+        for (size_t i = 0; i < commands.size(); i++) {
+            const OpCommand& item = commands.at(i);
+            if (item.code == OpCode::Label) {
+                labels[wstring(item.targets[0].value)] = i;
+            }
+        }
+        return labels;
     }
 
     Interpreter* Interpreter::ExecuteProgram(const wstring& program_name)
@@ -659,63 +701,410 @@ namespace jxcode::atomscript
 
         this->program_name_ = program_name;
 
-        wstring code = this->_loadfile_(program_name);
+        wstring image_path;
+        if (this->_imagepath_) {
+            image_path = this->_imagepath_(program_name);
+        }
+        if (!image_path.empty()) {
+            //预编译文件不需要词法与语法分析，只需把变量名换成槽位
+            this->image_ = std::make_shared<ProgramImage>(image_path);
+            this->labels_ = this->image_->labels();
+            this->program_ = std::make_shared<Program>(this->image_->Link(&this->symbols_));
+        }
+        else if (this->cache_ && !this->_readfile_utf8_ && !this->_readfile_) {
+            //多个解释器共享编译结果，每个解释器只复制指令并换成自己的槽位
+            this->compiled_ = this->LoadCompiled(program_name);
+            this->labels_ = this->compiled_->labels;
+            this->program_ = std::make_shared<Program>(this->compiled_->Link(&this->symbols_));
+        }
+        else if (this->is_lazy_load_ && !this->_readfile_utf8_ && !this->_readfile_) {
+            //只生成各块的入口，块在第一次执行到时编译
+            if (this->_loadfile_utf8_) {
+                auto code = std::make_shared<const string>(this->_loadfile_utf8_(program_name));
+                this->lazy_ = std::make_unique<LazyProgram>(code, &this->utf8_lexer_, program_name);
+            }
+            else {
+                auto code = std::make_shared<const wstring>(this->_loadfile_(program_name));
+                this->lazy_ = std::make_unique<LazyProgram>(code, &this->lexer_, program_name);
+            }
+            this->program_ = std::make_shared<Program>(this->lazy_->Prepare(&this->labels_));
+        }
+        else {
+            this->ParseSource(program_name, &this->tokens_, &this->commands_);
+            this->labels_ = CollectLabels(*this->commands_);
+            this->program_ = std::make_shared<Program>(CompileProgram(*this->commands_, this->labels_, &this->symbols_, this->is_optimize_));
+        }
+        this->PinLiterals(0);
+        //编译时分配的槽位
+        Variable undefined;
+        SetVariableUndefined(&undefined);
+        this->variables_.resize(this->symbols_.size(), undefined);
+        return this;
+    }
 
-        vector<shared_ptr<Token>> tokens = lexer::Scanner(&const_cast<wstring&>(code),
-            &get_atom_operator_map(),
-            &lexer::get_std_esc_char_map()
-        );
+    shared_ptr<const CompiledProgram> Interpreter::LoadCompiled(const wstring& program_name)
+    {
+        shared_ptr<const string> utf8_code;
+        shared_ptr<const wstring> code;
+        ProgramCache::Key key{ program_name, 0, this->is_optimize_ };
+        if (this->_loadfile_utf8_) {
+            utf8_code = std::make_shared<const string>(this->_loadfile_utf8_(program_name));
+            key.source_hash = HashBytes(utf8_code->data(), utf8_code->size());
+        }
+        else {
+            code = std::make_shared<const wstring>(this->_loadfile_(program_name));
+            key.source_hash = HashBytes(code->data(), code->size() * sizeof(wchar_t));
+        }
 
-        this->commands_ = ParseOpList(&const_cast<wstring&>(program_name), &tokens);
+        shared_ptr<const CompiledProgram> cached = this->cache_->Find(key);
+        if (cached) {
+            return cached;
+        }
 
-        //ȡбǩ
-        for (size_t i = 0; i < this->commands_->size(); i++) {
-            const OpCommand& item = this->commands_->at(i);
-            const wstring& token_value = *item.targets[0]->value;
-            if (item.code == OpCode::Label) {
-                this->labels_[token_value] = i;
-            }
+        auto compiled = std::make_shared<CompiledProgram>();
+        if (utf8_code) {
+            this->ParseCode(program_name, utf8_code, &compiled->tokens, &compiled->commands);
         }
-        return this;
+        else {
+            this->ParseCode(program_name, code, &compiled->tokens, &compiled->commands);
+        }
+        compiled->labels = CollectLabels(*compiled->commands);
+        SymbolTable symbols;
+        compiled->program = CompileProgram(*compiled->commands, compiled->labels, &symbols, this->is_optimize_);
+        compiled->symbols.resize(symbols.size());
+        for (auto& item : symbols.index()) {
+            compiled->symbols[item.second] = item.first;
+        }
+        this->cache_->Insert(key, compiled);
+        return compiled;
+    }
+
+    void Interpreter::CompileImage(const wstring& program_name, const wstring& image_path)
+    {
+        shared_ptr<lexer::TokenList> tokens;
+        shared_ptr<CommandList> commands;
+        this->ParseSource(program_name, &tokens, &commands);
+        auto labels = CollectLabels(*commands);
+
+        //文件内的槽位只包含这个程序的变量
+        SymbolTable symbols;
+        Program program = CompileProgram(*commands, labels, &symbols, this->is_optimize_);
+        ProgramImage::Write(image_path, program, symbols, labels);
+    }
+
+    int32_t Interpreter::EnterBlock(int32_t block)
+    {
+        size_t literal_count = this->program_->strings.size();
+        int32_t base = this->lazy_->Compile(block, this->program_.get(), &this->labels_, &this->symbols_);
+        this->PinLiterals(literal_count);
+        Variable undefined;
+        SetVariableUndefined(&undefined);
+        this->variables_.resize(this->symbols_.size(), undefined);
+        return base;
     }
 
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(ATOMSCRIPT_SWITCH_DISPATCH)
+    //GCC与Clang使用计算goto的线程化分派，其他编译器使用switch
+#define ATOMSCRIPT_THREADED_DISPATCH
+#endif
+
     bool Interpreter::Next()
     {
         if (this->is_end_) {
             return false;
         }
 
-        do {
-            if (this->exec_ptr_ + 1 >= (int32_t)this->opcmd_count()) {
+        Program* program = this->program_.get();
+        Instruction* code = program->code.data();
+        //程序结尾有两条End指令，If跳过最后一行时也会落在End上
+        int32_t ip = (std::min)(this->exec_ptr_ + 1, (int32_t)this->opcmd_count());
+
+        //字符串分配达到阈值或上一轮清除未完成时执行一步回收
+#define ATOMSCRIPT_GC_POINT() \
+        if (this->strpool_.is_sweeping() || this->strpool_.allocated_bytes() >= this->gc_threshold_) { \
+            this->GCStep(); \
+        }
+
+        //向回跳转时由即时编译器计数，热循环交给本地代码执行
+#define ATOMSCRIPT_BACK_EDGE(from) \
+        if (this->jit_ && ip <= (from)) { \
+            int32_t jit_ip = this->jit_->OnBackEdge(*program, (from), ip, this->variables_.data()); \
+            if (jit_ip >= 0) { \
+                ip = jit_ip; \
+            } \
+        }
+
+#ifdef ATOMSCRIPT_THREADED_DISPATCH
+        //与InstrCode的顺序一致
+        static const void* const dispatch_table[] = {
+            &&op_Nop, &&op_Call, &&op_If, &&op_Goto, &&op_GotoVar, &&op_Set,
+            &&op_Del, &&op_ClearSub, &&op_ToProg, &&op_Error,
+            &&op_IfGoto, &&op_IfGotoNum, &&op_IfGotoStr, &&op_IfGotoVar,
+            &&op_SetNumLiteral, &&op_CmpNumNum, &&op_CmpStrPtrEq, &&op_IfGotoNumNum, &&op_IfGotoStrPtrEq,
+            &&op_EnterBlock, &&op_End,
+        };
+#define ATOMSCRIPT_OP(name) op_##name:
+#define ATOMSCRIPT_DISPATCH() goto *dispatch_table[(size_t)code[ip].code]
+#else
+#define ATOMSCRIPT_OP(name) case InstrCode::name:
+#define ATOMSCRIPT_DISPATCH() goto dispatch
+#endif
+
+        try {
+#ifdef ATOMSCRIPT_THREADED_DISPATCH
+            ATOMSCRIPT_DISPATCH();
+#else
+        dispatch:
+            switch (code[ip].code) {
+#endif
+            ATOMSCRIPT_OP(Nop)
+            {
+                ++ip;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(If)
+            {
+                Instruction& ins = code[ip];
+                Variable x = this->GenTempVar(ins.x);
+                Variable y = this->GenTempVar(ins.y);
+                QuickenCompare(&ins, InstrCode::CmpNumNum, InstrCode::CmpStrPtrEq, x, y);
+                //条件不成功则下跳一行
+                ip += VariableOperate(this, ins.compare, x, y) ? 1 : 2;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(CmpNumNum)
+            {
+                Instruction& ins = code[ip];
+                float x, y;
+                if (!LoadNumber(this->variables_.data(), ins.x, &x) || !LoadNumber(this->variables_.data(), ins.y, &y)) {
+                    ins.code = InstrCode::If;
+                    ins.is_unstable = true;
+                    ATOMSCRIPT_DISPATCH();
+                }
+                ip += NumberCompare(ins.compare, x, y) ? 1 : 2;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(CmpStrPtrEq)
+            {
+                Instruction& ins = code[ip];
+                bool result;
+                if (!CompareStrPtr(this, this->literal_ptrs_.data(), this->variables_.data(), ins, &result)) {
+                    ins.code = InstrCode::If;
+                    ins.is_unstable = true;
+                    ATOMSCRIPT_DISPATCH();
+                }
+                ip += result ? 1 : 2;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(Goto)
+            {
+                ATOMSCRIPT_GC_POINT();
+                int32_t from = ip;
+                ip = code[ip].jump + 1;
+                ATOMSCRIPT_BACK_EDGE(from);
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(GotoVar)
+            {
+                ATOMSCRIPT_GC_POINT();
+                ip = this->FindLabel(&code[ip]) + 1;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(IfGoto)
+            {
+                Instruction& ins = code[ip];
+                Variable x = this->GenTempVar(ins.x);
+                Variable y = this->GenTempVar(ins.y);
+                QuickenCompare(&ins, InstrCode::IfGotoNumNum, InstrCode::IfGotoStrPtrEq, x, y);
+                if (!VariableOperate(this, ins.compare, x, y)) {
+                    ip += 2;
+                    ATOMSCRIPT_DISPATCH();
+                }
+                ATOMSCRIPT_GC_POINT();
+                int32_t from = ip;
+                ip = ins.jump + 1;
+                ATOMSCRIPT_BACK_EDGE(from);
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(IfGotoNum)
+            {
+                const Instruction& ins = code[ip];
+                const Variable& x = this->variables_[ins.x.slot];
+                if (x.type != VARIABLETYPE_NUMBER || !NumberCompare(ins.compare, x.num, ins.y.num)) {
+                    ip += 2;
+                    ATOMSCRIPT_DISPATCH();
+                }
+                ATOMSCRIPT_GC_POINT();
+                int32_t from = ip;
+                ip = ins.jump + 1;
+                ATOMSCRIPT_BACK_EDGE(from);
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(IfGotoNumNum)
+            {
+                Instruction& ins = code[ip];
+                float x, y;
+                if (!LoadNumber(this->variables_.data(), ins.x, &x) || !LoadNumber(this->variables_.data(), ins.y, &y)) {
+                    ins.code = InstrCode::IfGoto;
+                    ins.is_unstable = true;
+                    ATOMSCRIPT_DISPATCH();
+                }
+                if (!NumberCompare(ins.compare, x, y)) {
+                    ip += 2;
+                    ATOMSCRIPT_DISPATCH();
+                }
+                ATOMSCRIPT_GC_POINT();
+                int32_t from = ip;
+                ip = ins.jump + 1;
+                ATOMSCRIPT_BACK_EDGE(from);
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(IfGotoStrPtrEq)
+            {
+                Instruction& ins = code[ip];
+                bool result;
+                if (!CompareStrPtr(this, this->literal_ptrs_.data(), this->variables_.data(), ins, &result)) {
+                    ins.code = InstrCode::IfGoto;
+                    ins.is_unstable = true;
+                    ATOMSCRIPT_DISPATCH();
+                }
+                if (!result) {
+                    ip += 2;
+                    ATOMSCRIPT_DISPATCH();
+                }
+                ATOMSCRIPT_GC_POINT();
+                ip = ins.jump + 1;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(IfGotoStr)
+            {
+                const Instruction& ins = code[ip];
+                const Variable& x = this->variables_[ins.x.slot];
+                if (x.type != VARIABLETYPE_STRPTR || !IsStringEqual(this, x.ptr, this->literal_ptrs_[ins.y.str])) {
+                    ip += 2;
+                    ATOMSCRIPT_DISPATCH();
+                }
+                ATOMSCRIPT_GC_POINT();
+                ip = ins.jump + 1;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(IfGotoVar)
+            {
+                const Instruction& ins = code[ip];
+                Variable x = this->GenTempVar(ins.x);
+                Variable y = this->GenTempVar(ins.y);
+                if (!VariableOperate(this, ins.compare, x, y)) {
+                    ip += 2;
+                    ATOMSCRIPT_DISPATCH();
+                }
+                //报错时指向goto所在行
+                ++ip;
+                ATOMSCRIPT_GC_POINT();
+                ip = this->FindLabel(&code[ip]) + 1;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(Set)
+            {
+                Instruction& ins = code[ip];
+                Variable v = this->GenTempVar(ins.y);
+                if (v.type == VARIABLETYPE_UNDEFINED) {
+                    throw InterpreterException(*ins.y.token, L"variable not found");
+                }
+                this->variables_[ins.x.slot] = v;
+                if (ins.y.kind == OperandKind::Number) {
+                    ins.code = InstrCode::SetNumLiteral;
+                }
+                ++ip;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(SetNumLiteral)
+            {
+                const Instruction& ins = code[ip];
+                SetVariableNumber(&this->variables_[ins.x.slot], ins.y.num);
+                ++ip;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(Call)
+            {
+                ATOMSCRIPT_GC_POINT();
+                this->exec_ptr_ = ip;
+                if (!this->ExecuteCall(program->call_sites[code[ip].jump])) {
+                    return true;
+                }
+                //回调中可能跳转或加载了其他程序
+                program = this->program_.get();
+                code = program->code.data();
+                ip = this->exec_ptr_ + 1;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(Del)
+            ATOMSCRIPT_OP(ClearSub)
+            ATOMSCRIPT_OP(ToProg)
+            ATOMSCRIPT_OP(Error)
+            {
+                ATOMSCRIPT_GC_POINT();
+                this->exec_ptr_ = ip;
+                this->ExecuteInstruction(code[ip]);
+                program = this->program_.get();
+                code = program->code.data();
+                ip = this->exec_ptr_ + 1;
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(EnterBlock)
+            {
+                //编译时追加指令，报错时指向入口
+                this->exec_ptr_ = ip;
+                ip = this->EnterBlock(code[ip].jump);
+                program = this->program_.get();
+                code = program->code.data();
+                ATOMSCRIPT_DISPATCH();
+            }
+            ATOMSCRIPT_OP(End)
+            {
                 this->is_end_ = true;
                 this->_end_(this->program_name_);
                 this->ResetState();
                 return false;
             }
-
-            ++this->exec_ptr_;
-
-            //ÿ256ִһGC
-            if (this->exec_ptr_ > 0 && this->exec_ptr_ % 256 == 0) {
-                this->GCollect();
+#ifndef ATOMSCRIPT_THREADED_DISPATCH
             }
+#endif
+        }
+        catch (...) {
+            //ToProg加载新程序失败时exec_ptr_已被重置
+            if (this->program_.get() == program) {
+                this->exec_ptr_ = ip;
+            }
+            throw;
+        }
 
-        } while (this->ExecuteLine(this->commands_->at(this->exec_ptr_)));
-
+#undef ATOMSCRIPT_GC_POINT
+#undef ATOMSCRIPT_BACK_EDGE
+#undef ATOMSCRIPT_OP
+#undef ATOMSCRIPT_DISPATCH
         return true;
     }
 
-    void Interpreter::GotoLabel(const wstring& label)
+    void Interpreter::GotoLabel(wstring_view label)
     {
-        int32_t pos = (int32_t)this->labels_[label];
+        int32_t pos = (int32_t)this->labels_[wstring(label)];
         this->exec_ptr_ = pos;
     }
 
     void Interpreter::ResetMemory()
     {
-        this->ptr_alloc_index_ = 0;
-        decltype(this->variables_)().swap(this->variables_);
-        decltype(this->strpool_)().swap(this->strpool_);
+        //已编译的指令引用槽位，符号表保留，只清除变量值
+        for (Variable& var : this->variables_) {
+            SetVariableUndefined(&var);
+        }
+        this->strpool_.Clear();
+        //字符串指针会从头分配，goto var的缓存失效，字面值重新常驻
+        if (this->program_) {
+            for (Instruction& ins : this->program_->code) {
+                ins.label_ptr = 0;
+            }
+            this->PinLiterals(0);
+        }
     }
 
     inline static void StreamWriteInt32(ostream* stream, int32_t i)
@@ -769,24 +1158,41 @@ namespace jxcode::atomscript
         //state
 
         StreamWriteString(&ss, c.to_bytes(this->program_name_));
-        StreamWriteInt32(&ss, this->exec_ptr_);
-        StreamWriteInt32(&ss, this->ptr_alloc_index_);
+        //延迟编译时换算为整体编译时的下标
+        StreamWriteInt32(&ss, this->lazy_ ? this->lazy_->ToCommandIndex(this->exec_ptr_) : this->exec_ptr_);
+        StreamWriteInt32(&ss, this->strpool_.last_id());
 
         //variables
-        StreamWriteInt32(&ss, (int32_t)this->variables_.size());
-        for (auto& item : this->variables_) {
-
+        //按名字顺序写入已定义的变量
+        int32_t var_count = 0;
+        for (const Variable& var : this->variables_) {
+            if (var.type != VARIABLETYPE_UNDEFINED) {
+                ++var_count;
+            }
+        }
+        StreamWriteInt32(&ss, var_count);
+        for (auto& item : this->symbols_.index()) {
+            Variable& var = this->variables_[item.second];
+            if (var.type == VARIABLETYPE_UNDEFINED) {
+                continue;
+            }
             string name = c.to_bytes(item.first);
             StreamWriteString(&ss, name);
-            StreamWriteVariable(&ss, item.second);
+            StreamWriteVariable(&ss, var);
+        }
+        //strpool 只保存变量引用的字符串，常驻的字面值在加载程序时重新分配
+        std::set<int32_t> ptrs;
+        for (const Variable& var : this->variables_) {
+            if (var.type == VARIABLETYPE_STRPTR && this->strpool_.Contains(var.ptr)) {
+                ptrs.insert(var.ptr);
+            }
         }
-        //strpool
-        StreamWriteInt32(&ss, (int32_t)this->strpool_.size());
-        for (auto& item : this->strpool_) {
+        StreamWriteInt32(&ss, (int32_t)ptrs.size());
+        for (int32_t ptr : ptrs) {
 
-            StreamWriteInt32(&ss, item.first);
+            StreamWriteInt32(&ss, ptr);
 
-            string encode_str = c.to_bytes(item.second);
+            string encode_str = c.to_bytes(wstring(this->strpool_.View(ptr)));
             StreamWriteString(&ss, encode_str);
         }
 
@@ -804,7 +1210,13 @@ namespace jxcode::atomscript
         wstring program_name = (c.from_bytes(StreamReadString(&ss)));
         this->ExecuteProgram(program_name);
         this->exec_ptr_ = StreamReadInt32(&ss);
-        this->ptr_alloc_index_ = StreamReadInt32(&ss);
+        if (this->lazy_) {
+            this->exec_ptr_ = this->lazy_->FromCommandIndex(this->exec_ptr_, this->program_.get(), &this->labels_, &this->symbols_);
+            Variable undefined;
+            SetVariableUndefined(&undefined);
+            this->variables_.resize(this->symbols_.size(), undefined);
+        }
+        int32_t last_id = StreamReadInt32(&ss);
 
         //variables
         int32_t _length = StreamReadInt32(&ss);
@@ -816,14 +1228,19 @@ namespace jxcode::atomscript
             this->SetVar(name, var);
         }
 
-        //strpool
+        //strpool 加载程序时常驻的字面值按恢复后的id重新分配
 
+        this->strpool_.Clear();
         int32_t strpool_len = StreamReadInt32(&ss);
         for (int32_t i = 0; i < strpool_len; i++)
         {
             int32_t str_ptr = StreamReadInt32(&ss);
             wstring str = c.from_bytes(StreamReadString(&ss));
-            this->strpool_[str_ptr] = str;
+            this->strpool_.Restore(str_ptr, str);
+        }
+        this->strpool_.set_last_id(last_id);
+        if (this->program_) {
+            this->PinLiterals(0);
         }
     }
 
@@ -869,12 +1286,7 @@ namespace jxcode::atomscript
         }
     }
 
-    wstring strlib_lib::cat(const wstring& str1, const wstring& str2)
-    {
-        return str1 + str2;
-    }
-
-    int strlib_lib::cmp(const wstring& str1, const wstring& str2)
+    int strlib_lib::cmp(wstring_view str1, wstring_view str2)
     {
         return str1 == str2;
     }
@@ -892,11 +1304,12 @@ namespace jxcode::atomscript
         }
 
         if (name == L"cat") {
-            int id = inter->NewStrPtr(cat(*inter->GetString(v[0].ptr), *inter->GetString(v[1].ptr)));
+            //在上次拼接的结果后继续拼接时直接追加
+            int id = inter->CatStrPtr(v[0].ptr, v[1].ptr);
             params->push(GetVariableStrPtr(id));
         }
         else if (name == L"cmp") {
-            int b = cmp(*inter->GetString(v[0].ptr), *inter->GetString(v[1].ptr));
+            int b = cmp(inter->strpool().View(v[0].ptr), inter->strpool().View(v[1].ptr));
             params->push(GetVariableNumber((float)b));
         }
     }
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <cinttypes>
@@ -7,13 +8,21 @@
 #include <functional>
 #include <stack>
 #include "Token.h"
+#include "Lexer.h"
 #include "OpCommand.h"
+#include "Bytecode.h"
+#include "ProgramImage.h"
+#include "ProgramCache.h"
+#include "LazyProgram.h"
+#include "StringPool.h"
+#include "Jit.h"
 #include "Variable.h"
 
 namespace jxcode::atomscript
 {
     using std::string;
     using std::wstring;
+    using std::wstring_view;
     using std::map;
     using std::vector;
     using std::shared_ptr;
@@ -26,7 +35,7 @@ namespace jxcode::atomscript
     protected:
         virtual std::wstring get_name() override;
     public:
-        InterpreterException(const std::shared_ptr<Token>& token, const std::wstring& message);
+        InterpreterException(const Token& token, const std::wstring& message);
     public:
         virtual std::wstring what() override;
     };
@@ -35,71 +44,145 @@ namespace jxcode::atomscript
     {
     public:
         using LoadFileCallBack = function<wstring(const wstring& program_name_)>;
-        //öΪ̬޷ڱҵuser_type_ptrΪ0
+        //返回UTF-8编码的源码，设置后优先于LoadFileCallBack
+        using LoadFileUtf8CallBack = function<string(const wstring& program_name_)>;
+        //分块读取源码，从offset处读取最多capacity个字符，返回读取的字符数，0表示结束
+        //设置后优先于LoadFileCallBack
+        using ReadFileCallBack = function<size_t(const wstring& program_name_, size_t offset, wchar_t* buffer, size_t capacity)>;
+        using ReadFileUtf8CallBack = function<size_t(const wstring& program_name_, size_t offset, char* buffer, size_t capacity)>;
+        //如果调用对象为静态对象（无法在变量表中找到）则user_type_ptr为0
         using FuncallCallBack = function<bool(
             const int32_t& user_ptr, 
             const vector<Token>& domain,
             const vector<Token>& path,
             const vector<Variable>& params)>;
         using EndCallBack = function<void(const wstring& program_name)>;
+        //返回程序的预编译文件路径，返回空字符串时从源码加载
+        using ImagePathCallBack = function<wstring(const wstring& program_name_)>;
     protected:
         LoadFileCallBack _loadfile_;
         FuncallCallBack _funcall_;
         EndCallBack _end_;
+        LoadFileUtf8CallBack _loadfile_utf8_;
+        ReadFileCallBack _readfile_;
+        ReadFileUtf8CallBack _readfile_utf8_;
+        ImagePathCallBack _imagepath_;
 
-        bool OnFunCall(const int32_t& user_ptr,
-            const vector<Token>& domain,
-            const vector<Token>& path,
-            const vector<Variable>& params);
+        lexer::Lexer lexer_;
+        lexer::Utf8Lexer utf8_lexer_;
+
+        bool is_parallel_load_;
+        size_t parallel_thread_count_;
+        bool is_optimize_;
+        bool is_lazy_load_;
+        std::unique_ptr<LoopJit> jit_; // 未启用时为空
+
+        bool OnFunCall(const int32_t& user_ptr, const CallShape& call, const vector<Variable>& params);
 
         wstring program_name_; //ser
-        bool is_end_; // ǰűǷ
+        bool is_end_; // 当前脚本运行是否结束
 
-        map<wstring, shared_ptr<vector<OpCommand>>> commands_cache_; // TODO ܸ
-        shared_ptr<vector<OpCommand>> commands_;
+        shared_ptr<ProgramCache> cache_; // 未启用时为空
+        shared_ptr<const CompiledProgram> compiled_; // 从缓存加载时代替tokens_与commands_
+        shared_ptr<lexer::TokenList> tokens_; // commands_中Token视图引用的缓冲区
+        shared_ptr<CommandList> commands_;
+        shared_ptr<ProgramImage> image_; // 从预编译文件加载时代替tokens_与commands_
+        std::unique_ptr<LazyProgram> lazy_; // 延迟编译时持有源码与各块的命令
+        shared_ptr<Program> program_; // commands_编译后的指令
 
         int32_t exec_ptr_; //ser
-        map<wstring, size_t> labels_;
+        LabelMap labels_;
 
-        map<wstring, Variable> variables_; //ser
-        map<int32_t, wstring> strpool_; //ser
-        int32_t ptr_alloc_index_; //ser
+        SymbolTable symbols_; // 变量名到槽位，只增不减
+        vector<Variable> variables_; //ser 按槽位保存，删除的变量为未定义
+        StringPool strpool_; //ser 包括最后分配的id
+        vector<int32_t> literal_ptrs_; // 程序中字符串字面值常驻后的指针，按program_->strings下标
+
+        static constexpr size_t kGCMinBytes = 256 * 1024; // 两轮回收之间至少分配的字节数
+        static constexpr size_t kGCSweepStep = 256; // 执行中每步最多检查的字符串id数
+        size_t gc_threshold_; // 分配的字节数超过时开始新一轮回收，为上次回收后存活字节数
+
+        int32_t return_slot_; // __return的槽位
+        vector<Variable> call_params_; // 调用参数缓冲区
+        std::stack<Variable> call_stack_; // 内置库的参数栈
     public:
         int32_t line_num() const;
         size_t opcmd_count() const;
         const wstring& program_name() const;
-        const map<wstring, Variable>& variables();
-        const map<int32_t, wstring>& strpool();
+        map<wstring, Variable, std::less<>> variables() const;
+        const StringPool& strpool() const;
     public:
         Interpreter(
             LoadFileCallBack _loadfile_,
             FuncallCallBack _funcall_,
             EndCallBack _end_);
+    public:
+        void SetUtf8Loader(LoadFileUtf8CallBack _loadfile_utf8_);
+        void SetStreamReader(ReadFileCallBack _readfile_);
+        void SetUtf8StreamReader(ReadFileUtf8CallBack _readfile_utf8_);
+        //设置后优先从预编译文件加载程序，包括toprog与反序列化
+        void SetImageLoader(ImagePathCallBack _imagepath_);
+        //整体读取的源码按程序名与内容散列共享编译结果，同一个cache可供多个解释器使用，传入空取消
+        void SetProgramCache(const shared_ptr<ProgramCache>& cache);
+        //整体读取的源码在换行处切分后多线程解析，thread_count为0时使用硬件线程数
+        void SetParallelLoad(bool enable, size_t thread_count = 0);
+        //整体读取的源码只预扫描标签，每块在第一次执行到时才编译，加载时间与脚本长度基本无关
+        //标签需要位于行首，语法错误在执行到所在块时抛出，不进行数据流优化
+        void SetLazyLoad(bool enable);
+        //加载时进行常量传播、删除不可达代码与死存储，对之后加载的程序生效
+        void SetOptimize(bool enable);
+        //热循环编译为本地代码，当前平台不支持时返回false并继续解释执行
+        bool SetJit(bool enable);
     protected:
-        bool ExecuteLine(const OpCommand& cmd);
-        Variable GenTempVar(const std::shared_ptr<Token>& token);
+        //按已设置的读取方式读取源码并解析为命令
+        void ParseSource(const wstring& program_name, shared_ptr<lexer::TokenList>* tokens, shared_ptr<CommandList>* commands);
+        void ParseCode(const wstring& program_name, const shared_ptr<const string>& code, shared_ptr<lexer::TokenList>* tokens, shared_ptr<CommandList>* commands);
+        void ParseCode(const wstring& program_name, const shared_ptr<const wstring>& code, shared_ptr<lexer::TokenList>* tokens, shared_ptr<CommandList>* commands);
+        //读取源码后先查找缓存，没有时编译并加入缓存
+        shared_ptr<const CompiledProgram> LoadCompiled(const wstring& program_name);
+        //编译延迟加载的块，返回块首下标
+        int32_t EnterBlock(int32_t block);
+        void ExecuteInstruction(const Instruction& ins);
+        //开始一轮回收，标记变量引用的字符串
+        void MarkStrings();
+        //从first开始的字符串字面值常驻到字符串池
+        void PinLiterals(size_t first);
+        //执行中的分步回收，需要时开始新一轮
+        void GCStep();
+        //goto var的目标标签下标，按变量的字符串指针缓存在指令中
+        int32_t FindLabel(Instruction* goto_var);
+        bool ExecuteCall(const CallSite& site);
+        Variable GenTempVar(const Operand& op);
         Variable GenTempVar(const float& num);
-        Variable GenTempVar(const wstring& str);
+        Variable GenTempVar(wstring_view str);
+        //取得变量槽位，不存在时分配
+        int32_t VarSlot(wstring_view name);
     public:
-        bool IsExistLabel(const wstring& label);
-        void SetVar(const wstring& name, const float& num);
-        void SetVar(const wstring& name, const wstring& str);
-        void SetVar(const wstring& name, const int& user_id);
-        void SetVar(const wstring& name, const Variable& var);
-        void DelVar(const wstring& name);
-        Variable GetVar(const wstring& name);
+        bool IsExistLabel(wstring_view label);
+        void SetVar(wstring_view name, const float& num);
+        void SetVar(wstring_view name, wstring_view str);
+        void SetVar(wstring_view name, const int& user_id);
+        void SetVar(wstring_view name, const Variable& var);
+        void DelVar(wstring_view name);
+        Variable GetVar(wstring_view name);
     public:
-        int GetStrPtr(const wstring& str);
-        int NewStrPtr(const wstring& str);
-        wstring* GetString(const int& strptr);
+        int GetStrPtr(wstring_view str);
+        int NewStrPtr(wstring_view str);
+        //拼接两个字符串，结果较长时为负的指针，不与相同内容的字符串共用指针
+        int CatStrPtr(const int& strptr1, const int& strptr2);
+        //不存在的指针返回空字符串，视图在字符串被回收前有效
+        wstring_view GetString(const int& strptr);
+        //完整回收一次
         void GCollect();
         void SetReturnVariable(const Variable& var);
     public:
         Interpreter* ExecuteProgram(const wstring& program_name);
-        //Ƿн
+        //离线编译：读取源码，按当前的优化设置编译后写入image_path，不影响当前状态
+        void CompileImage(const wstring& program_name, const wstring& image_path);
+        //返回是否运行结束
         bool Next();
 
-        void GotoLabel(const wstring& label);
+        void GotoLabel(wstring_view label);
 
         void ResetState();
         void ResetMemory();
@@ -120,8 +203,7 @@ namespace jxcode::atomscript
     };
     class strlib_lib {
     public:
-        static wstring cat(const wstring& str1, const wstring& str2);
-        static int cmp(const wstring& str1, const wstring& str2);
+        static int cmp(wstring_view str1, wstring_view str2);
         static void Invoke(Interpreter* inter, const wstring& name, std::stack<Variable>* params);
     };
 
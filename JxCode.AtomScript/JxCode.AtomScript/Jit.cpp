@@ -0,0 +1,483 @@
+#include "Jit.h"
+#include <cstddef>
+#include <cstring>
+#include <map>
+
+#ifdef ATOMSCRIPT_JIT_X64
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+namespace jxcode::atomscript
+{
+    using namespace std;
+    using namespace lexer;
+
+#ifdef ATOMSCRIPT_JIT_X64
+    static void* AllocExecutable(const vector<uint8_t>& code)
+    {
+#ifdef _WIN32
+        void* ptr = VirtualAlloc(nullptr, code.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (ptr == nullptr) {
+            return nullptr;
+        }
+        memcpy(ptr, code.data(), code.size());
+        DWORD old_protect;
+        if (!VirtualProtect(ptr, code.size(), PAGE_EXECUTE_READ, &old_protect)) {
+            VirtualFree(ptr, 0, MEM_RELEASE);
+            return nullptr;
+        }
+        FlushInstructionCache(GetCurrentProcess(), ptr, code.size());
+        return ptr;
+#else
+        void* ptr = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            return nullptr;
+        }
+        memcpy(ptr, code.data(), code.size());
+        if (mprotect(ptr, code.size(), PROT_READ | PROT_EXEC) != 0) {
+            munmap(ptr, code.size());
+            return nullptr;
+        }
+        return ptr;
+#endif
+    }
+
+    static void FreeExecutable(void* ptr, size_t size)
+    {
+#ifdef _WIN32
+        (void)size;
+        VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+        munmap(ptr, size);
+#endif
+    }
+
+    //x86-64机器码生成，变量数组基址放在r8，只使用易失寄存器rax、r8、xmm0、xmm1，不使用栈
+    class X64Emitter
+    {
+    public:
+        enum Cond : uint8_t
+        {
+            kAboveEqual = 0x3,
+            kEqual = 0x4,
+            kNotEqual = 0x5,
+            kAbove = 0x7,
+            kParity = 0xA,
+        };
+    protected:
+        vector<uint8_t> code_;
+    public:
+        const vector<uint8_t>& code() const { return this->code_; }
+        size_t size() const { return this->code_.size(); }
+    protected:
+        void Byte(uint8_t b) { this->code_.push_back(b); }
+        void Int32(int32_t v)
+        {
+            for (int i = 0; i < 4; i++) {
+                this->Byte((uint8_t)((uint32_t)v >> (i * 8)));
+            }
+        }
+        //[r8 + disp32]，reg为ModRM.reg
+        void MemR8(uint8_t reg, int32_t disp)
+        {
+            this->Byte(0x80 | (reg << 3));
+            this->Int32(disp);
+        }
+    public:
+        void LoadArgument()
+        {
+#ifdef _WIN32
+            //mov r8, rcx
+            this->Byte(0x49); this->Byte(0x89); this->Byte(0xC8);
+#else
+            //mov r8, rdi
+            this->Byte(0x49); this->Byte(0x89); this->Byte(0xF8);
+#endif
+        }
+        //cmp dword [r8 + disp], imm
+        void CmpMemImm(int32_t disp, int32_t imm)
+        {
+            this->Byte(0x41); this->Byte(0x81); this->MemR8(7, disp); this->Int32(imm);
+        }
+        //mov dword [r8 + disp], imm
+        void MovMemImm(int32_t disp, int32_t imm)
+        {
+            this->Byte(0x41); this->Byte(0xC7); this->MemR8(0, disp); this->Int32(imm);
+        }
+        //movss xmm, [r8 + disp]
+        void LoadFloat(uint8_t xmm, int32_t disp)
+        {
+            this->Byte(0xF3); this->Byte(0x41); this->Byte(0x0F); this->Byte(0x10); this->MemR8(xmm, disp);
+        }
+        //movss [r8 + disp], xmm
+        void StoreFloat(int32_t disp, uint8_t xmm)
+        {
+            this->Byte(0xF3); this->Byte(0x41); this->Byte(0x0F); this->Byte(0x11); this->MemR8(xmm, disp);
+        }
+        //mov eax, bits; movd xmm, eax
+        void LoadFloatImm(uint8_t xmm, float value)
+        {
+            int32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            this->MovEaxImm(bits);
+            this->Byte(0x66); this->Byte(0x0F); this->Byte(0x6E); this->Byte(0xC0 | (xmm << 3));
+        }
+        //addss/subss/mulss/divss/sqrtss xmm0, xmm1
+        void FloatOp(uint8_t opcode, uint8_t dst, uint8_t src)
+        {
+            this->Byte(0xF3); this->Byte(0x0F); this->Byte(opcode); this->Byte(0xC0 | (dst << 3) | src);
+        }
+        //ucomiss xmm_a, xmm_b
+        void Ucomiss(uint8_t a, uint8_t b)
+        {
+            this->Byte(0x0F); this->Byte(0x2E); this->Byte(0xC0 | (a << 3) | b);
+        }
+        void MovEaxImm(int32_t imm)
+        {
+            this->Byte(0xB8); this->Int32(imm);
+        }
+        void Ret()
+        {
+            this->Byte(0xC3);
+        }
+        //返回rel32字段的位置，之后用Patch填写
+        size_t Jcc(Cond cond)
+        {
+            this->Byte(0x0F); this->Byte(0x80 | cond);
+            size_t pos = this->size();
+            this->Int32(0);
+            return pos;
+        }
+        size_t Jmp()
+        {
+            this->Byte(0xE9);
+            size_t pos = this->size();
+            this->Int32(0);
+            return pos;
+        }
+        void Patch(size_t pos, size_t target)
+        {
+            int32_t rel = (int32_t)((int64_t)target - (int64_t)(pos + 4));
+            memcpy(&this->code_[pos], &rel, sizeof(rel));
+        }
+    };
+
+    inline static int32_t TypeDisp(int32_t slot) { return slot * (int32_t)sizeof(Variable); }
+    inline static int32_t NumDisp(int32_t slot) { return slot * (int32_t)sizeof(Variable) + (int32_t)offsetof(Variable, num); }
+
+    //生成一个循环的本地代码
+    class LoopCompiler
+    {
+    protected:
+        struct Fixup
+        {
+            size_t pos;
+            int32_t target; //跳转后执行的指令下标
+        };
+    protected:
+        const Program& program_;
+        int32_t head_;
+        int32_t back_edge_;
+        int32_t return_slot_;
+        X64Emitter emitter_;
+        vector<size_t> offsets_;
+        vector<Fixup> fixups_;
+    public:
+        LoopCompiler(const Program& program, int32_t head, int32_t back_edge, int32_t return_slot)
+            : program_(program), head_(head), back_edge_(back_edge), return_slot_(return_slot)
+        {
+        }
+    protected:
+        bool IsInLoop(int32_t ip) const
+        {
+            return ip >= this->head_ && ip <= this->back_edge_;
+        }
+        void JumpTo(int32_t target)
+        {
+            this->fixups_.push_back(Fixup{ this->emitter_.Jmp(), target });
+        }
+        void JumpIf(X64Emitter::Cond cond, int32_t target)
+        {
+            this->fixups_.push_back(Fixup{ this->emitter_.Jcc(cond), target });
+        }
+        //变量不是数字时返回当前指令下标
+        void GuardNumber(const Operand& op, int32_t ip)
+        {
+            if (op.kind == OperandKind::Ident) {
+                this->emitter_.CmpMemImm(TypeDisp(op.slot), VARIABLETYPE_NUMBER);
+                this->JumpIf(X64Emitter::kNotEqual, -1 - ip);
+            }
+        }
+        static bool IsNumberOperand(const Operand& op)
+        {
+            return op.kind == OperandKind::Number || op.kind == OperandKind::Ident;
+        }
+        void LoadOperand(uint8_t xmm, const Operand& op)
+        {
+            if (op.kind == OperandKind::Number) {
+                this->emitter_.LoadFloatImm(xmm, op.num);
+            }
+            else {
+                this->emitter_.LoadFloat(xmm, NumDisp(op.slot));
+            }
+        }
+        //条件成立时执行on_true，否则执行on_false
+        bool EmitCompare(const Instruction& ins, int32_t ip, int32_t on_true, int32_t on_false)
+        {
+            if (!IsNumberOperand(ins.x) || !IsNumberOperand(ins.y)) {
+                return false;
+            }
+            this->GuardNumber(ins.x, ip);
+            this->GuardNumber(ins.y, ip);
+            this->LoadOperand(0, ins.x);
+            this->LoadOperand(1, ins.y);
+
+            //无序比较（NaN）时ZF、PF、CF都为1，与C++比较结果一致
+            switch (ins.compare)
+            {
+            case TokenType::GreaterThan:
+                this->emitter_.Ucomiss(0, 1);
+                this->JumpIf(X64Emitter::kAbove, on_true);
+                break;
+            case TokenType::GreaterThanEqual:
+                this->emitter_.Ucomiss(0, 1);
+                this->JumpIf(X64Emitter::kAboveEqual, on_true);
+                break;
+            case TokenType::LessThan:
+                this->emitter_.Ucomiss(1, 0);
+                this->JumpIf(X64Emitter::kAbove, on_true);
+                break;
+            case TokenType::LessThanEqual:
+                this->emitter_.Ucomiss(1, 0);
+                this->JumpIf(X64Emitter::kAboveEqual, on_true);
+                break;
+            case TokenType::DoubleEqual:
+            {
+                this->emitter_.Ucomiss(0, 1);
+                size_t unordered = this->emitter_.Jcc(X64Emitter::kParity);
+                this->JumpIf(X64Emitter::kEqual, on_true);
+                this->emitter_.Patch(unordered, this->emitter_.size());
+                break;
+            }
+            case TokenType::ExclamatoryAndEqual:
+                this->emitter_.Ucomiss(0, 1);
+                this->JumpIf(X64Emitter::kParity, on_true);
+                this->JumpIf(X64Emitter::kNotEqual, on_true);
+                break;
+            default:
+                //其他运算符对数字总是不成立
+                break;
+            }
+            this->JumpTo(on_false);
+            return true;
+        }
+        bool EmitSet(const Instruction& ins, int32_t ip)
+        {
+            if (!IsNumberOperand(ins.y)) {
+                return false;
+            }
+            this->GuardNumber(ins.y, ip);
+            this->LoadOperand(0, ins.y);
+            this->emitter_.MovMemImm(TypeDisp(ins.x.slot), VARIABLETYPE_NUMBER);
+            this->emitter_.StoreFloat(NumDisp(ins.x.slot), 0);
+            return true;
+        }
+        bool EmitCall(const Instruction& ins, int32_t ip)
+        {
+            const CallSite& site = this->program_.call_sites[ins.jump];
+            const CallShape& call = site.static_call;
+            if (call.target != CallTarget::Math || call.error != nullptr) {
+                return false;
+            }
+
+            uint8_t opcode;
+            size_t arity = 2;
+            if (call.function == L"add") opcode = 0x58;
+            else if (call.function == L"sub") opcode = 0x5C;
+            else if (call.function == L"mul") opcode = 0x59;
+            else if (call.function == L"div") opcode = 0x5E;
+            else if (call.function == L"sqrt") { opcode = 0x51; arity = 1; }
+            else return false;
+
+            if (call.args.size() < arity) {
+                return false;
+            }
+            for (const Operand& arg : call.args) {
+                if (!IsNumberOperand(arg)) {
+                    return false;
+                }
+            }
+
+            //math被定义为变量时按实例调用交给宿主
+            this->emitter_.CmpMemImm(TypeDisp(site.object_slot), VARIABLETYPE_UNDEFINED);
+            this->JumpIf(X64Emitter::kNotEqual, -1 - ip);
+            for (const Operand& arg : call.args) {
+                this->GuardNumber(arg, ip);
+            }
+
+            this->LoadOperand(0, call.args[0]);
+            if (arity == 2) {
+                this->LoadOperand(1, call.args[1]);
+                this->emitter_.FloatOp(opcode, 0, 1);
+            }
+            else {
+                this->emitter_.FloatOp(opcode, 0, 0);
+            }
+            this->emitter_.MovMemImm(TypeDisp(this->return_slot_), VARIABLETYPE_NUMBER);
+            this->emitter_.StoreFloat(NumDisp(this->return_slot_), 0);
+            return true;
+        }
+        bool EmitInstruction(const Instruction& ins, int32_t ip)
+        {
+            switch (ins.code)
+            {
+            case InstrCode::Nop:
+                return true;
+            case InstrCode::Set:
+            case InstrCode::SetNumLiteral:
+                return this->EmitSet(ins, ip);
+            case InstrCode::Call:
+                return this->EmitCall(ins, ip);
+            case InstrCode::Goto:
+                this->JumpTo(ins.jump + 1);
+                return true;
+            case InstrCode::If:
+            case InstrCode::CmpNumNum:
+                return this->EmitCompare(ins, ip, ip + 1, ip + 2);
+            case InstrCode::IfGoto:
+            case InstrCode::IfGotoNum:
+            case InstrCode::IfGotoNumNum:
+                return this->EmitCompare(ins, ip, ins.jump + 1, ip + 2);
+            default:
+                return false;
+            }
+        }
+    public:
+        //不能编译时返回false
+        bool Compile()
+        {
+            const vector<Instruction>& code = this->program_.code;
+            this->emitter_.LoadArgument();
+            for (int32_t ip = this->head_; ip <= this->back_edge_; ip++) {
+                this->offsets_.push_back(this->emitter_.size());
+                if (!this->EmitInstruction(code[ip], ip)) {
+                    return false;
+                }
+            }
+            //最后一条之后顺序执行
+            this->JumpTo(this->back_edge_ + 1);
+
+            //循环内的目标直接跳转，其他目标与去优化返回下标给解释器
+            map<int32_t, size_t> exits;
+            for (const Fixup& fixup : this->fixups_) {
+                int32_t target = fixup.target < 0 ? -1 - fixup.target : fixup.target;
+                size_t dest;
+                if (fixup.target >= 0 && this->IsInLoop(target)) {
+                    dest = this->offsets_[target - this->head_];
+                }
+                else {
+                    auto it = exits.find(target);
+                    if (it == exits.end()) {
+                        it = exits.emplace(target, this->emitter_.size()).first;
+                        this->emitter_.MovEaxImm(target);
+                        this->emitter_.Ret();
+                    }
+                    dest = it->second;
+                }
+                this->emitter_.Patch(fixup.pos, dest);
+            }
+            return true;
+        }
+        const vector<uint8_t>& code() const { return this->emitter_.code(); }
+    };
+#endif
+
+    bool LoopJit::IsSupported()
+    {
+#ifdef ATOMSCRIPT_JIT_X64
+        return sizeof(Variable) == 8;
+#else
+        return false;
+#endif
+    }
+
+    LoopJit::LoopJit(int32_t return_slot) : return_slot_(return_slot)
+    {
+    }
+
+    LoopJit::~LoopJit()
+    {
+        this->Clear();
+    }
+
+    void LoopJit::Clear()
+    {
+#ifdef ATOMSCRIPT_JIT_X64
+        for (const CodeBlock& block : this->blocks_) {
+            FreeExecutable(block.ptr, block.size);
+        }
+#endif
+        this->blocks_.clear();
+        this->loops_.clear();
+    }
+
+    int32_t LoopJit::OnBackEdge(const Program& program, int32_t back_edge, int32_t head, Variable* vars)
+    {
+        if (this->loops_.size() < program.size()) {
+            this->loops_.resize(program.size());
+        }
+        LoopState& loop = this->loops_[back_edge];
+        if (loop.is_failed) {
+            return -1;
+        }
+        if (loop.func == nullptr) {
+            if (++loop.count < kHotLoopCount) {
+                return -1;
+            }
+            loop.head = head;
+            loop.func = this->Compile(program, head, back_edge);
+            if (loop.func == nullptr) {
+                loop.is_failed = true;
+                return -1;
+            }
+        }
+
+        int32_t next = loop.func(vars);
+        //停在循环内说明发生了去优化
+        if (next >= loop.head && next <= back_edge && ++loop.deopts >= kMaxDeopts) {
+            loop.is_failed = true;
+        }
+        return next;
+    }
+
+    LoopJit::LoopFunc LoopJit::Compile(const Program& program, int32_t head, int32_t back_edge)
+    {
+#ifdef ATOMSCRIPT_JIT_X64
+        LoopCompiler compiler(program, head, back_edge, this->return_slot_);
+        if (!compiler.Compile()) {
+            return nullptr;
+        }
+        void* ptr = AllocExecutable(compiler.code());
+        if (ptr == nullptr) {
+            return nullptr;
+        }
+        this->blocks_.push_back(CodeBlock{ ptr, compiler.code().size() });
+        return reinterpret_cast<LoopFunc>(ptr);
+#else
+        (void)program;
+        (void)head;
+        (void)back_edge;
+        return nullptr;
+#endif
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Bytecode.h"
+#include "Variable.h"
+
+#if (defined(_M_X64) || defined(__x86_64__)) && !defined(ATOMSCRIPT_NO_JIT)
+#define ATOMSCRIPT_JIT_X64
+#endif
+
+namespace jxcode::atomscript
+{
+    //热循环即时编译，只在x86-64上可用
+    //回边执行次数达到阈值后，把从目标到回边之间的指令编译为本地代码，
+    //要求循环内只有数字的Set、If、Goto与math库的四则运算和sqrt。
+    //本地代码直接读写变量槽位，每条指令执行完后状态与解释执行一致；
+    //遇到类型不符或math被定义为变量时返回当前指令下标，由解释器继续执行（去优化）
+    class LoopJit
+    {
+    public:
+        //回边执行多少次后编译
+        static constexpr uint32_t kHotLoopCount = 1000;
+        //去优化次数超过后不再进入本地代码
+        static constexpr uint32_t kMaxDeopts = 16;
+    protected:
+        using LoopFunc = int32_t(*)(Variable* vars);
+        struct LoopState
+        {
+            uint32_t count = 0;
+            uint32_t deopts = 0;
+            bool is_failed = false;
+            int32_t head = -1;
+            LoopFunc func = nullptr;
+        };
+        struct CodeBlock
+        {
+            void* ptr;
+            size_t size;
+        };
+    protected:
+        int32_t return_slot_;
+        std::vector<LoopState> loops_; //按回边指令下标
+        std::vector<CodeBlock> blocks_;
+    public:
+        //当前平台是否支持
+        static bool IsSupported();
+    public:
+        LoopJit(int32_t return_slot);
+        LoopJit(const LoopJit&) = delete;
+        LoopJit& operator=(const LoopJit&) = delete;
+        ~LoopJit();
+    public:
+        //程序被释放或重新加载时清除计数与本地代码
+        void Clear();
+        //解释器执行了从back_edge跳到head的回边，
+        //返回本地代码执行后解释器继续执行的下标，没有执行本地代码时返回-1
+        int32_t OnBackEdge(const Program& program, int32_t back_edge, int32_t head, Variable* vars);
+    protected:
+        LoopFunc Compile(const Program& program, int32_t head, int32_t back_edge);
+    };
+}
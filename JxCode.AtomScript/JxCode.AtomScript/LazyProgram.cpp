@@ -0,0 +1,227 @@
+#include "LazyProgram.h"
+#include <algorithm>
+#include "Utf8.h"
+
+namespace jxcode::atomscript
+{
+    using namespace std;
+    using namespace lexer;
+
+    inline static Instruction MakeStub(InstrCode code, int32_t jump)
+    {
+        Instruction ins;
+        ins.code = code;
+        ins.compare = TokenType::Unknow;
+        ins.jump = jump;
+        ins.x = Operand{ OperandKind::None, {0}, nullptr };
+        ins.y = Operand{ OperandKind::None, {0}, nullptr };
+        ins.cmd = nullptr;
+        ins.error = nullptr;
+        ins.is_unstable = false;
+        ins.label_ptr = 0;
+        return ins;
+    }
+
+    inline static void OffsetString(Operand* op, int32_t offset)
+    {
+        if (op->kind == OperandKind::String) {
+            op->str += offset;
+        }
+    }
+
+    LazyProgram::LazyProgram(const shared_ptr<const wstring>& code, Lexer* lexer, const wstring& program_name)
+        : code_(code), lexer_(lexer), utf8_lexer_(nullptr), program_name_(program_name)
+    {
+        this->Split(*code, *lexer);
+    }
+
+    LazyProgram::LazyProgram(const shared_ptr<const string>& code, Utf8Lexer* lexer, const wstring& program_name)
+        : utf8_code_(code), lexer_(nullptr), utf8_lexer_(lexer), program_name_(program_name)
+    {
+        this->Split(*code, *lexer);
+    }
+
+    inline static wstring ToLabelName(wstring_view name)
+    {
+        return wstring(name);
+    }
+    inline static wstring ToLabelName(string_view name)
+    {
+        return Utf8ToWide(name);
+    }
+
+    template<typename CharT>
+    void LazyProgram::Split(const basic_string<CharT>& code, const BasicLexer<CharT>& lexer)
+    {
+        Block first;
+        first.begin = 0;
+        first.first_line = 0;
+        this->blocks_.push_back(std::move(first));
+
+        for (const auto& line : lexer.ScanLabelLines(code)) {
+            if (line.offset == 0) {
+                //第一行就是标签
+                this->blocks_[0].label = ToLabelName(line.name);
+                continue;
+            }
+            this->blocks_.back().end = line.offset;
+            Block block;
+            block.begin = line.offset;
+            block.first_line = line.line;
+            block.label = ToLabelName(line.name);
+            this->blocks_.push_back(std::move(block));
+        }
+        this->blocks_.back().end = code.size();
+    }
+
+    Program LazyProgram::Prepare(LabelMap* labels) const
+    {
+        Program program;
+        program.code.reserve(this->blocks_.size() * 2);
+        for (size_t i = 0; i < this->blocks_.size(); i++) {
+            program.code.push_back(MakeStub(InstrCode::Nop, -1));
+            program.code.push_back(MakeStub(InstrCode::EnterBlock, (int32_t)i));
+            //同名标签以最后一个为准
+            if (!this->blocks_[i].label.empty()) {
+                (*labels)[this->blocks_[i].label] = i * 2;
+            }
+        }
+        return program;
+    }
+
+    void LazyProgram::Parse(Block* block)
+    {
+        size_t consumed;
+        bool is_end;
+        block->tokens = make_shared<TokenList>();
+        if (this->utf8_code_) {
+            auto chunk = make_shared<const string>(*this->utf8_code_, block->begin, block->end - block->begin);
+            *block->tokens = WidenTokenList(this->utf8_lexer_->ScanChunk(chunk, true, block->first_line, &consumed, &is_end));
+        }
+        else {
+            auto chunk = make_shared<const wstring>(*this->code_, block->begin, block->end - block->begin);
+            *block->tokens = this->lexer_->ScanChunk(chunk, true, block->first_line, &consumed, &is_end);
+        }
+        auto commands = make_shared<CommandList>();
+        CommandParser parser;
+        parser.Parse(&this->program_name_, block->tokens.get(), commands.get());
+        block->commands = commands;
+    }
+
+    size_t LazyProgram::command_count(size_t block)
+    {
+        if (!this->blocks_[block].commands) {
+            this->Parse(&this->blocks_[block]);
+        }
+        return this->blocks_[block].commands->size();
+    }
+
+    int32_t LazyProgram::Compile(size_t index, Program* program, LabelMap* labels, SymbolTable* symbols)
+    {
+        Block& block = this->blocks_[index];
+        if (block.base >= 0) {
+            return block.base;
+        }
+        if (!block.commands) {
+            this->Parse(&block);
+        }
+        const CommandList& commands = *block.commands;
+        int32_t base = (int32_t)program->code.size();
+
+        //指向本块入口的标签改为指向块首，不在行首的标签只在没有同名标签时加入
+        for (size_t i = 0; i < commands.size(); i++) {
+            const OpCommand& cmd = commands.at(i);
+            if (cmd.code != OpCode::Label) {
+                continue;
+            }
+            auto it = labels->find(wstring(cmd.targets[0].value));
+            if (it == labels->end()) {
+                labels->emplace(wstring(cmd.targets[0].value), base + i);
+            }
+            else if (it->second == index * 2) {
+                it->second = base + i;
+            }
+        }
+
+        Program part = CompileProgram(commands, *labels, symbols, false);
+        int32_t string_offset = (int32_t)program->strings.size();
+        int32_t call_offset = (int32_t)program->call_sites.size();
+
+        for (size_t i = 0; i < commands.size(); i++) {
+            Instruction ins = part.code[i];
+            OffsetString(&ins.x, string_offset);
+            OffsetString(&ins.y, string_offset);
+            if (ins.code == InstrCode::Call) {
+                ins.jump += call_offset;
+            }
+            program->code.push_back(ins);
+        }
+        program->strings.insert(program->strings.end(), part.strings.begin(), part.strings.end());
+        for (CallSite& site : part.call_sites) {
+            site.id += call_offset;
+            for (Operand& arg : site.static_call.args) {
+                OffsetString(&arg, string_offset);
+            }
+            for (Operand& arg : site.instance_call.args) {
+                OffsetString(&arg, string_offset);
+            }
+            program->call_sites.push_back(std::move(site));
+        }
+
+        //块尾接到下一块，If跳过最后一行时落在第二条上
+        if (index + 1 < this->blocks_.size()) {
+            const Block& next = this->blocks_[index + 1];
+            int32_t target = next.base >= 0 ? next.base : (int32_t)(index + 1) * 2;
+            program->code.push_back(MakeStub(InstrCode::Goto, target));
+            program->code.push_back(MakeStub(InstrCode::Goto, target));
+        }
+        else {
+            program->code.push_back(MakeStub(InstrCode::End, -1));
+            program->code.push_back(MakeStub(InstrCode::End, -1));
+        }
+
+        //入口改为跳到块首
+        program->code[index * 2 + 1] = MakeStub(InstrCode::Goto, base - 1);
+        block.base = base;
+        return base;
+    }
+
+    int32_t LazyProgram::ToCommandIndex(int32_t index)
+    {
+        if (index < 0) {
+            return index;
+        }
+        //入口位于块首之前
+        int32_t entry_block = index < (int32_t)this->blocks_.size() * 2 ? index / 2 : -1;
+        int32_t prefix = 0;
+        for (size_t i = 0; i < this->blocks_.size(); i++) {
+            int32_t count = (int32_t)this->command_count(i);
+            if (entry_block == (int32_t)i) {
+                return prefix - 1;
+            }
+            const Block& block = this->blocks_[i];
+            if (block.base >= 0 && index >= block.base && index < block.base + count + 2) {
+                return prefix + (index - block.base);
+            }
+            prefix += count;
+        }
+        return prefix;
+    }
+
+    int32_t LazyProgram::FromCommandIndex(int32_t index, Program* program, LabelMap* labels, SymbolTable* symbols)
+    {
+        if (index < 0) {
+            return index;
+        }
+        int32_t prefix = 0;
+        for (size_t i = 0; i < this->blocks_.size(); i++) {
+            int32_t count = (int32_t)this->command_count(i);
+            if (index < prefix + count || i + 1 == this->blocks_.size()) {
+                int32_t base = this->Compile(i, program, labels, symbols);
+                return base + (std::min)(index - prefix, count);
+            }
+            prefix += count;
+        }
+        return index;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include "Token.h"
+#include "Lexer.h"
+#include "OpCommand.h"
+#include "Bytecode.h"
+#include "SymbolTable.h"
+
+namespace jxcode::atomscript
+{
+    //延迟编译的程序：加载时只预扫描以标签开头的行，在这些行把源码切分为块，
+    //块在第一次进入时才进行词法分析、解析与编译，指令追加到程序末尾
+    //  程序开头每块有两条入口指令：第2b条为标签位置（Nop），第2b+1条为EnterBlock，
+    //  未编译块的标签指向入口，编译后入口改为跳到块首的Goto，标签改为指向块首
+    //  每块末尾有两条跳到下一块的Goto（最后一块为End），If跳过块的最后一行时落在第二条上
+    //不在行首的标签要等所在块编译后才能找到；延迟编译时不进行数据流优化
+    class LazyProgram
+    {
+    protected:
+        struct Block
+        {
+            size_t begin;
+            size_t end;
+            int first_line;
+            std::wstring label;  //第一块为空
+            int32_t base = -1;   //编译后在程序中的起始下标
+            std::shared_ptr<lexer::TokenList> tokens;
+            std::shared_ptr<CommandList> commands; //解析后不为空
+        };
+    protected:
+        std::shared_ptr<const std::wstring> code_;
+        std::shared_ptr<const std::string> utf8_code_;
+        lexer::Lexer* lexer_;
+        lexer::Utf8Lexer* utf8_lexer_;
+        std::wstring program_name_;
+        std::vector<Block> blocks_;
+    public:
+        //lexer需要比本对象存活更久
+        LazyProgram(const std::shared_ptr<const std::wstring>& code, lexer::Lexer* lexer, const std::wstring& program_name);
+        LazyProgram(const std::shared_ptr<const std::string>& code, lexer::Utf8Lexer* lexer, const std::wstring& program_name);
+    public:
+        //生成入口指令，labels中的标签指向入口
+        Program Prepare(LabelMap* labels) const;
+        //编译第block块并追加到program，返回块首下标，已编译时直接返回
+        int32_t Compile(size_t block, Program* program, LabelMap* labels, SymbolTable* symbols);
+        //程序下标与整体编译时的命令下标互相换算，用于序列化，需要解析之前的所有块
+        int32_t ToCommandIndex(int32_t index);
+        int32_t FromCommandIndex(int32_t index, Program* program, LabelMap* labels, SymbolTable* symbols);
+    protected:
+        template<typename CharT>
+        void Split(const std::basic_string<CharT>& code, const lexer::BasicLexer<CharT>& lexer);
+        void Parse(Block* block);
+        size_t command_count(size_t block);
+    };
+}
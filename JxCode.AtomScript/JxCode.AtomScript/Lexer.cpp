@@ -2,8 +2,12 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <type_traits>
 #include "lexer.h"
 #include "Token.h"
+#include "CharScan.h"
+#include "Utf8.h"
 
 namespace jxcode
 {
@@ -23,6 +27,9 @@ namespace jxcode
             return ss.str();
         }
 
+        LexerUnexpectedEndException::LexerUnexpectedEndException(const size_t& line, const size_t& pos_, const std::wstring& message)
+            : LexerException(line, pos_, message) { }
+
         using std::wstring;
         using std::map;
         using std::vector;
@@ -38,59 +45,92 @@ namespace jxcode
         std::wstring scan_multiline_note_lbracket_opr = std::wstring(L"/*");
         std::wstring scan_multiline_note_rbracket_opr = std::wstring(L"*/");
 
-        int cur_global_pos;
-        int cur_line;
-        int cur_position;
+        bool scan_vectorized = true;
 
-        //һݣҲν
-        wstring* code_content;
-        map<wstring, TokenType>* token_map;
-        map<wstring, wstring>* esc_char_map;
+        template<typename CharT>
+        inline static bool IsNumber(const CharT& c) {
+            return (GetCharClass(c) & kCharNumber) != 0;
+        }
+        template<typename CharT>
+        inline static bool IsSymbol(const CharT& c) {
+            return (GetCharClass(c) & kCharSymbol) != 0;
+        }
+        template<typename CharT>
+        inline static bool IsControlSymbol(const CharT& c) {
+            return (GetCharClass(c) & kCharControl) != 0;
+        }
+        template<typename CharT>
+        inline static bool IsWord(const CharT& c) {
+            return (GetCharClass(c) & (kCharSymbol | kCharControl | kCharNumber)) == 0;
+        }
 
-        inline wchar_t GetChar(int pos = cur_global_pos) {
-            if (code_content->length() <= pos) {
-                return 0;
+        //配置与转义表以宽字符给出，UTF-8分析器构造时转换一次
+        template<typename CharT>
+        inline static std::basic_string<CharT> FromWide(const wstring& str) {
+            if constexpr (std::is_same_v<CharT, wchar_t>) {
+                return str;
+            }
+            else {
+                return WideToUtf8(str);
             }
-            return (*code_content)[pos];
         }
-
-        inline void Reset() {
-            cur_line = -1;
-            cur_position = -1;
-            cur_global_pos = -1;
+        template<typename CharT>
+        inline static map<std::basic_string<CharT>, std::basic_string<CharT>> FromWide(const map<wstring, wstring>& mp) {
+            map<std::basic_string<CharT>, std::basic_string<CharT>> result;
+            for (auto& item : mp) {
+                result[FromWide<CharT>(item.first)] = FromWide<CharT>(item.second);
+            }
+            return result;
+        }
+
+        //单字符配置均为ASCII
+        template<typename CharT>
+        BasicLexer<CharT>::BasicLexer(const OperatorTable& tokenTable, const map<wstring, wstring>& escMap)
+            : scan_space((CharT)lexer::scan_space),
+            scan_is_parse_note(lexer::scan_is_parse_note),
+            scan_is_parse_lf(lexer::scan_is_parse_lf),
+            scan_string_bracket((CharT)lexer::scan_string_bracket),
+            scan_string_escape_char((CharT)lexer::scan_string_escape_char),
+            scan_single_note_opr(FromWide<CharT>(lexer::scan_single_note_opr)),
+            scan_multiline_note_lbracket_opr(FromWide<CharT>(lexer::scan_multiline_note_lbracket_opr)),
+            scan_multiline_note_rbracket_opr(FromWide<CharT>(lexer::scan_multiline_note_rbracket_opr)),
+            scan_vectorized(lexer::scan_vectorized),
+            token_table_(tokenTable), esc_char_map_(FromWide<CharT>(escMap)),
+            code_content_(nullptr), token_list_(nullptr), cur_global_pos_(-1), cur_line_(-1), cur_position_(-1)
+        {
         }
-        inline bool IsNumber(const wchar_t& c) {
-            return c >= L'0' && c <= L'9';
+        template<typename CharT>
+        BasicLexer<CharT>::BasicLexer(const map<wstring, TokenType>& tokenList, const map<wstring, wstring>& escMap)
+            : BasicLexer(OperatorTable(tokenList), escMap)
+        {
         }
 
-        inline bool IsString(const wchar_t& c) {
-            return scan_string_bracket == c;
-        }
-        inline bool IsSymbol(const wchar_t& c) {
-            if (c > 127) {
-                return false;
+        template<typename CharT>
+        CharT BasicLexer<CharT>::GetChar(int pos) const {
+            if ((int)code_content_->length() <= pos) {
+                return 0;
             }
-            return (c >= 33 && c <= 47) ||
-                (c >= 58 && c <= 64) ||
-                (c >= 91 && c <= 94) || (c == 96) || //95 = _
-                (c >= 123 && c <= 126);
+            return (*code_content_)[pos];
         }
-        inline bool IsControlSymbol(const wchar_t& c) {
-            return (c >= 0 && c <= 31) || c == 127;
+        template<typename CharT>
+        CharT BasicLexer<CharT>::GetChar() const {
+            return this->GetChar(this->cur_global_pos_);
         }
-        inline bool IsWord(const wchar_t& c) {
-            return !(IsSymbol(c) || IsControlSymbol(c) || IsNumber(c));
+
+        template<typename CharT>
+        void BasicLexer<CharT>::Reset() {
+            cur_line_ = -1;
+            cur_position_ = -1;
+            cur_global_pos_ = -1;
         }
 
-        inline bool IsKeyOpr(const wstring& str, TokenType* out_type) {
-            bool b = token_map->count(str) != 0;
-            if (b) {
-                *out_type = (*token_map)[str];
-            }
-            return b;
+        template<typename CharT>
+        bool BasicLexer<CharT>::IsKeyOpr(string_view_type str, TokenType* out_type) const {
+            return token_table_.Find(str.data(), str.length(), out_type);
         }
 
-        inline int GetCharType(const wchar_t& c) {
+        template<typename CharT>
+        int BasicLexer<CharT>::GetCharType(const CharT& c) const {
             if (c == scan_space)
                 return 0;
             if (IsNumber(c))
@@ -101,46 +141,90 @@ namespace jxcode
                 return 3;
             return 4; //Word
         }
-        inline bool CharTypeEquals(int pos, int pos2) {
-            wchar_t c1 = GetChar(pos);
-            wchar_t c2 = GetChar(pos2);
-            return GetCharType(c1) == GetCharType(c2);
-        }
 
-        inline wchar_t NextChar() {
-            if ((int)code_content->length() <= cur_global_pos + 1) {
-                cur_global_pos = (int)code_content->length();
+        template<typename CharT>
+        CharT BasicLexer<CharT>::NextChar() {
+            if ((int)code_content_->length() <= cur_global_pos_ + 1) {
+                cur_global_pos_ = (int)code_content_->length();
                 return 0;
             }
-            cur_global_pos++;
-            wchar_t c = (*code_content)[cur_global_pos];
-            if (c == L'\n') {
-                cur_position = -1;
-                cur_line++;
+            cur_global_pos_++;
+            CharT c = (*code_content_)[cur_global_pos_];
+            if (c == '\n') {
+                cur_position_ = -1;
+                cur_line_++;
             }
-            else {
-                cur_position++;
+            else if (!IsUtf8Continuation(c)) {
+                cur_position_++;
             }
             return c;
         }
-        inline void Next(int length) {
+        template<typename CharT>
+        void BasicLexer<CharT>::Next(int length) {
             for (int i = 0; i < length; i++) NextChar();
         }
-        inline void SkipSpace() {
-            wchar_t c = GetChar();
-            while (c == L' ' || c == L'\t' || c == L'\r') {
+        template<typename CharT>
+        void BasicLexer<CharT>::Advance(int pos) {
+            int length = (int)code_content_->length();
+            //最后一个经过的字符
+            int last = pos < length ? pos : length - 1;
+            if (last - cur_global_pos_ <= 16) {
+                //距离较短时逐字符处理
+                while (cur_global_pos_ < last) {
+                    CharT c = (*code_content_)[++cur_global_pos_];
+                    if (c == '\n') {
+                        cur_position_ = -1;
+                        cur_line_++;
+                    }
+                    else if (!IsUtf8Continuation(c)) {
+                        cur_position_++;
+                    }
+                }
+            }
+            else {
+                const CharT* begin = code_content_->data() + cur_global_pos_ + 1;
+                const CharT* end = code_content_->data() + last + 1;
+                size_t lf_count = charscan::CountChar(begin, end, '\n');
+                if (lf_count != 0) {
+                    const CharT* lf = end - 1;
+                    while (*lf != '\n') --lf;
+                    cur_line_ += (int)lf_count;
+                    cur_position_ = (int)charscan::CountColumn(lf + 1, end) - 1;
+                }
+                else {
+                    cur_position_ += (int)charscan::CountColumn(begin, end);
+                }
+            }
+            cur_global_pos_ = pos < length ? pos : length;
+        }
+        template<typename CharT>
+        void BasicLexer<CharT>::SkipSpace() {
+            if (scan_vectorized) {
+                //大多数token前没有或只有一个空白，先逐字符判断
+                if (!(GetCharClass(GetChar()) & kCharSpace)) {
+                    return;
+                }
+                const CharT* data = code_content_->data();
+                const CharT* p = charscan::SkipSpace(data + cur_global_pos_, data + code_content_->length());
+                Advance((int)(p - data));
+                return;
+            }
+            CharT c = GetChar();
+            while (c == ' ' || c == '\t' || c == '\r') {
                 NextChar();
                 c = GetChar();
             }
         }
-        inline wchar_t PeekChar(int offset = 1) {
-            if ((int)code_content->length() <= cur_global_pos + offset) {
+        template<typename CharT>
+        CharT BasicLexer<CharT>::PeekChar(int offset) const {
+            if ((int)code_content_->length() <= cur_global_pos_ + offset) {
                 return 0;
             }
-            return (*code_content)[(size_t)cur_global_pos + (size_t)offset];
+            return (*code_content_)[(size_t)cur_global_pos_ + (size_t)offset];
         }
 
-        inline bool is_cur_singleline_note() {
+        template<typename CharT>
+        bool BasicLexer<CharT>::is_cur_singleline_note() const {
             for (int i = 0; i < scan_single_note_opr.length(); i++) {
                 if (scan_single_note_opr[i] != PeekChar(i)) {
                     return false;
@@ -148,7 +232,8 @@ namespace jxcode
             }
             return true;
         }
-        inline bool is_cur_multiline_note() {
+        template<typename CharT>
+        bool BasicLexer<CharT>::is_cur_multiline_note() const {
             for (int i = 0; i < scan_multiline_note_lbracket_opr.length(); i++) {
                 if (scan_multiline_note_lbracket_opr[i] != PeekChar(i)) {
                     return false;
@@ -156,68 +241,86 @@ namespace jxcode
             }
             return true;
         }
-        inline bool is_curc_space() {
-            return GetChar() == L' ' || GetChar() == L'\r';
+        template<typename CharT>
+        bool BasicLexer<CharT>::is_curc_space() const {
+            return GetChar() == ' ' || GetChar() == '\r';
         }
-        inline bool is_curc_lf() {
-            return GetChar() == L'\n';
+        template<typename CharT>
+        bool BasicLexer<CharT>::is_curc_lf() const {
+            return GetChar() == '\n';
         }
-        inline bool is_curc_symbol() {
+        template<typename CharT>
+        bool BasicLexer<CharT>::is_curc_symbol() const {
             return IsSymbol(GetChar());
         }
-        inline bool is_curc_null() {
+        template<typename CharT>
+        bool BasicLexer<CharT>::is_curc_null() const {
             return GetChar() == 0;
         }
 
-        inline static bool ShouldGetNumber() {
-            wchar_t c = PeekChar(0);
-            return IsNumber(c) || (c == L'-' && IsNumber(PeekChar(1)));
+        template<typename CharT>
+        bool BasicLexer<CharT>::ShouldGetNumber() const {
+            CharT c = PeekChar(0);
+            return IsNumber(c) || (c == '-' && IsNumber(PeekChar(1)));
         }
 
-        wstring GetNumber() {
+        template<typename CharT>
+        typename BasicLexer<CharT>::string_view_type BasicLexer<CharT>::Substr(int pos, int length) const {
+            return string_view_type(*code_content_).substr(pos, length);
+        }
+
+        template<typename CharT>
+        typename BasicLexer<CharT>::string_view_type BasicLexer<CharT>::GetNumber() {
             int length = 0;
             bool isDecimal = false;
 
-            wchar_t c = GetChar();
-            if (c == L'-') {
+            CharT c = GetChar();
+            if (c == '-') {
                 if (!IsNumber(PeekChar(1))) {
-                    throw LexerException((size_t)cur_line + 1, (size_t)cur_position + 1, L"Number format error");
+                    throw LexerException((size_t)cur_line_ + 1, (size_t)cur_position_ + 1, L"Number format error");
                 }
                 length++;
                 c = PeekChar(length);
             }
 
-            while (IsNumber(c) || c == L'.') {
-                if (c == L'.') {
+            while (IsNumber(c) || c == '.') {
+                if (c == '.') {
                     if (isDecimal) {
-                        throw LexerException((size_t)cur_line + 1, (size_t)cur_position + 1, L"Number format error");
+                        throw LexerException((size_t)cur_line_ + 1, (size_t)cur_position_ + 1, L"Number format error");
                     }
                     isDecimal = true;
                 }
                 length++;
                 c = PeekChar(length);
             }
-            int head = cur_global_pos;
+            int head = cur_global_pos_;
             Next(length);
-            return code_content->substr(head, length);
+            return Substr(head, length);
         }
-        wstring GetString() {
+        template<typename CharT>
+        typename BasicLexer<CharT>::string_view_type BasicLexer<CharT>::GetString() {
 
-            wchar_t c;
+            CharT c;
+            int head = cur_global_pos_ + 1;
             int len = 0;
-            wstring appstr;
+            //没有转义字符时直接引用源码，有转义时才需要单独储存
+            bool has_esc = false;
+            string_type appstr;
             while (true) {
                 c = PeekChar();
 
                 if (c == 0) {
-                    throw LexerException((size_t)cur_line + 1, (size_t)cur_position + 1, L"ַûнβ");
+                    if (cur_global_pos_ + 1 >= (int)code_content_->length()) {
+                        throw LexerUnexpectedEndException((size_t)cur_line_ + 1, (size_t)cur_position_ + 1, L"字符串没有结尾");
+                    }
+                    throw LexerException((size_t)cur_line_ + 1, (size_t)cur_position_ + 1, L"字符串没有结尾");
                 }
 
-                //תƷ¸ַ
+                //是转移符则跳过下个字符
                 if (c == scan_string_escape_char) {
-                    const wstring* ref1 = nullptr;
-                    const wstring* ref2 = nullptr;
-                    for (auto& item : *esc_char_map) {
+                    const string_type* ref1 = nullptr;
+                    const string_type* ref2 = nullptr;
+                    for (auto& item : esc_char_map_) {
                         int count = 0;
                         for (int i = 0; i < item.first.length(); i++)
                         {
@@ -232,66 +335,64 @@ namespace jxcode
                         }
                     }
                     if (ref2 == nullptr) {
-                        throw LexerException((size_t)cur_line + 1, (size_t)cur_position + 1, L"ַת");
+                        throw LexerException((size_t)cur_line_ + 1, (size_t)cur_position_ + 1, L"字符串转义错误");
+                    }
+                    if (!has_esc) {
+                        has_esc = true;
+                        appstr.assign(Substr(head, len));
                     }
                     appstr += *ref2;
-                    Next(1 + ref1->length()); // \n
+                    Next(1 + (int)ref1->length()); // \n
                     continue;
                 }
-                //ַ
+                //字符串结束符
                 if (c == scan_string_bracket) {
                     NextChar();
                     break;
                 }
 
-                appstr += c;
+                if (has_esc) {
+                    appstr += c;
+                }
+                else {
+                    ++len;
+                }
                 NextChar();
             }
 
             NextChar(); // "
-            return appstr;
-        }
-        wstring GetSymbol(TokenType* type) {
-            vector<wstring> matchList;
-            int length = 0;
-            //<ַ, TokenType>
-            for (auto it = token_map->begin(); it != token_map->end(); it++) {
-                length = 0;
-                const wstring& key = it->first;
-                for (int i = 0; i < key.length(); i++) {
-                    if (key[i] == PeekChar(i)) {
-                        length++;
-                    }
-                }
-                if (key.length() == length) {
-                    matchList.push_back(key);
-                }
+            if (has_esc) {
+                return token_list_->Store(std::move(appstr));
             }
-
-            wstring str;
-            if (matchList.size() == 0) {
+            return Substr(head, len);
+        }
+        template<typename CharT>
+        typename BasicLexer<CharT>::string_view_type BasicLexer<CharT>::GetSymbol(TokenType* type) {
+            //<字符, TokenType>
+            size_t length = token_table_.Match(
+                code_content_->data() + cur_global_pos_,
+                code_content_->length() - cur_global_pos_,
+                type);
+            if (length == 0) {
                 *type = TokenType::Unknow;
-                str = GetChar();
+                length = 1;
             }
-            else {
-                //ƥ
-                int maxIndex = 0;
-                for (int i = 0; i < matchList.size(); i++) {
-                    if (matchList[i].length() > matchList[maxIndex].length()) {
-                        maxIndex = i;
-                    }
-                }
-                str = matchList[maxIndex];
-                *type = (*token_map)[str];
-            }
-
-            Next((int)str.length());
+            string_view_type str = Substr(cur_global_pos_, (int)length);
+            Next((int)length);
             return str;
         }
-        wstring GetIdent() {
+        template<typename CharT>
+        typename BasicLexer<CharT>::string_view_type BasicLexer<CharT>::GetIdent() {
             int length = 0;
-            int first = cur_global_pos;
-
+            int first = cur_global_pos_;
+
+            if (scan_vectorized) {
+                const CharT* data = code_content_->data();
+                const CharT* p = charscan::FindIdentEnd(data + first + 1, data + code_content_->length());
+                length = (int)(p - data) - first;
+                Advance(first + length);
+                return Substr(first, length);
+            }
             while (true) {
                 NextChar();
                 length++;
@@ -299,27 +400,59 @@ namespace jxcode
                     break;
                 }
             }
-            wstring str = code_content->substr(first, length);
-            return str;
+            return Substr(first, length);
         }
 
-        wstring GetNote() {
+        template<typename CharT>
+        typename BasicLexer<CharT>::string_view_type BasicLexer<CharT>::GetNote() {
             int length = 0;
             int first = 0;
+            int code_length = (int)code_content_->length();
+            const CharT* data = code_content_->data();
             if (is_cur_singleline_note()) {
-                first = cur_global_pos + (int)scan_single_note_opr.length();
+                first = cur_global_pos_ + (int)scan_single_note_opr.length();
+                if (scan_vectorized) {
+                    const CharT* p = charscan::FindChar(data + (std::min)(first, code_length), data + code_length, '\n');
+                    length = (std::max)((int)(p - data) - first, 0);
+                    Advance((int)(p - data));
+                    return Substr(first, length);
+                }
                 Next((int)scan_single_note_opr.length() - 1);
-                wchar_t c;
-                while ((c = NextChar()) != L'\n') {
+                CharT c;
+                //文件末尾的单行注释没有换行
+                while ((c = NextChar()) != '\n' && cur_global_pos_ < code_length) {
                     length++;
                 }
             }
             else if (is_cur_multiline_note()) {
-                first = cur_global_pos + (int)scan_multiline_note_lbracket_opr.length();
+                size_t line = (size_t)cur_line_ + 1;
+                size_t position = (size_t)cur_position_ + 1;
+                first = cur_global_pos_ + (int)scan_multiline_note_lbracket_opr.length();
+                if (scan_vectorized) {
+                    const CharT* end = data + code_length;
+                    const CharT* p = data + (std::min)(first, code_length);
+                    const string_type& rbracket = scan_multiline_note_rbracket_opr;
+                    while (true) {
+                        p = charscan::FindChar(p, end, rbracket[0]);
+                        if ((size_t)(end - p) < rbracket.length()) {
+                            throw LexerUnexpectedEndException(line, position, L"注释没有结尾");
+                        }
+                        if (string_view_type(p, rbracket.length()) == rbracket) {
+                            break;
+                        }
+                        ++p;
+                    }
+                    length = (int)(p - data) - first;
+                    Advance((int)(p - data + rbracket.length()));
+                    return Substr(first, length);
+                }
                 Next((int)scan_multiline_note_lbracket_opr.length() - 1);
-                wchar_t nChar;
+                CharT nChar;
                 while (true) {
                     if ((nChar = NextChar()) != scan_multiline_note_rbracket_opr[0]) {
+                        if (cur_global_pos_ >= code_length) {
+                            throw LexerUnexpectedEndException(line, position, L"注释没有结尾");
+                        }
                         length++;
                         continue;
                     }
@@ -329,7 +462,7 @@ namespace jxcode
                             count++;
                         }
                     }
-                    //עƥ
+                    //注释右括号匹配
                     if (count == scan_multiline_note_rbracket_opr.length()) {
                         length += count;
                         Next(count);
@@ -342,46 +475,47 @@ namespace jxcode
                     }
                 }
             }
-            return code_content->substr(first, length);
+            return Substr(first, length);
         }
 
-        bool GetToken(Token* out_token) {
+        template<typename CharT>
+        bool BasicLexer<CharT>::GetToken(token_type* out_token) {
 
             SkipSpace();
-            wchar_t c = GetChar();
+            CharT c = GetChar();
             if (!c) return false;
 
-            //1пʼ
-            out_token->line = cur_line + 1;
-            out_token->position = cur_position + 1;
+            //从1行开始
+            out_token->line = cur_line_ + 1;
+            out_token->position = cur_position_ + 1;
 
-            int startPosition = cur_global_pos;
-            if (c == L'\n') {
-                out_token->value = make_shared<wstring>(wstring(L"\n"));
+            int startPosition = cur_global_pos_;
+            if (c == '\n') {
+                out_token->value = Substr(startPosition, 1);
                 NextChar();
                 out_token->token_type = TokenType::LF;
             }
             else if (is_cur_singleline_note() || is_cur_multiline_note()) {
-                out_token->value = make_shared<wstring>(GetNote());
+                out_token->value = GetNote();
                 out_token->token_type = TokenType::Note;
             }
             else if (ShouldGetNumber()) {
-                out_token->value = make_shared<wstring>(GetNumber());
+                out_token->value = GetNumber();
                 out_token->token_type = TokenType::Number;
             }
             else if (scan_string_bracket == c) {
-                out_token->value = make_shared<wstring>(GetString());
+                out_token->value = GetString();
                 out_token->token_type = TokenType::String;
             }
             else if (IsSymbol(c)) {
                 TokenType type;
-                out_token->value = make_shared<wstring>(GetSymbol(&type));
+                out_token->value = GetSymbol(&type);
                 out_token->token_type = (type);
             }
             else if (IsWord(c)) {
-                wstring str = GetIdent();
+                string_view_type str = GetIdent();
                 TokenType type;
-                out_token->value = make_shared<wstring>(str);
+                out_token->value = str;
                 if (IsKeyOpr(str, &type)) {
                     out_token->token_type = type;
                 }
@@ -389,23 +523,21 @@ namespace jxcode
                     out_token->token_type = TokenType::Ident;
                 }
             }
-            if (startPosition == cur_global_pos)
+            if (startPosition == cur_global_pos_)
                 return false;
             return true;
         }
-        std::vector<shared_ptr<Token>> Scanner(
-            wstring* code,
-            map<wstring, TokenType>* tokenList,
-            std::map<std::wstring, std::wstring>* escMap
-        ) {
+
+        template<typename CharT>
+        BasicTokenList<CharT> BasicLexer<CharT>::Scan(const shared_ptr<const string_type>& code)
+        {
             Reset();
-            code_content = code;
-            token_map = tokenList;
-            esc_char_map = escMap;
+            token_list_type tokens(code);
+            code_content_ = code.get();
+            token_list_ = &tokens;
 
-            vector<shared_ptr<Token>> tokens;
-            Token token;
-            cur_line = 0;
+            token_type token;
+            cur_line_ = 0;
 
             NextChar();
             while (GetToken(&token)) {
@@ -416,11 +548,172 @@ namespace jxcode
                 else if (type == TokenType::LF && !scan_is_parse_lf) {
                     continue;
                 }
-                tokens.push_back(make_shared<Token>(token));
+                tokens.tokens.push_back(token);
+            }
+            code_content_ = nullptr;
+            token_list_ = nullptr;
+            return tokens;
+        }
+
+        template<typename CharT>
+        BasicTokenList<CharT> BasicLexer<CharT>::ScanChunk(
+            const shared_ptr<const string_type>& code,
+            bool is_last,
+            int first_line,
+            size_t* out_consumed,
+            bool* out_is_end)
+        {
+            Reset();
+            token_list_type tokens(code);
+            code_content_ = code.get();
+            token_list_ = &tokens;
+
+            token_type token;
+            cur_line_ = first_line;
+
+            //最近一个换行Token之后的位置，回退时从这里重新开始
+            size_t safe_pos = 0;
+            size_t safe_count = 0;
+
+            *out_is_end = is_last;
+            NextChar();
+            try {
+                while (GetToken(&token)) {
+                    TokenType type = token.token_type;
+                    if (type == TokenType::LF) {
+                        safe_pos = (size_t)cur_global_pos_;
+                        safe_count = tokens.tokens.size() + (scan_is_parse_lf ? 1 : 0);
+                    }
+                    if (type == TokenType::Note && !scan_is_parse_note) {
+                        continue;
+                    }
+                    else if (type == TokenType::LF && !scan_is_parse_lf) {
+                        continue;
+                    }
+                    tokens.tokens.push_back(token);
+                }
             }
+            catch (LexerUnexpectedEndException&) {
+                if (is_last) {
+                    code_content_ = nullptr;
+                    token_list_ = nullptr;
+                    throw;
+                }
+                tokens.tokens.resize(safe_count);
+                *out_consumed = safe_pos;
+                code_content_ = nullptr;
+                token_list_ = nullptr;
+                return tokens;
+            }
+            //遇到'\0'时与Scan一样视为源码结束
+            if (cur_global_pos_ < (int)code->length()) {
+                *out_is_end = true;
+            }
+            *out_consumed = code->length();
+            code_content_ = nullptr;
+            token_list_ = nullptr;
             return tokens;
         }
 
+        template<typename CharT>
+        std::vector<typename BasicLexer<CharT>::LabelLine> BasicLexer<CharT>::ScanLabelLines(const string_type& code) const
+        {
+            std::vector<LabelLine> lines;
+            const CharT* data = code.data();
+            const CharT* end = data + code.length();
+            const CharT* p = data;
+            int line = 0;
+            bool is_line_head = true;
+
+            auto starts_with = [&end](const CharT* p, const string_type& str) {
+                return !str.empty() && (size_t)(end - p) >= str.length() && string_view_type(p, str.length()) == str;
+            };
+            //注释的第一个字符，大多数字符只需比较一次
+            CharT single_note_head = scan_single_note_opr.empty() ? 0 : scan_single_note_opr[0];
+            CharT multiline_note_head = scan_multiline_note_lbracket_opr.empty() ? 0 : scan_multiline_note_lbracket_opr[0];
+
+            while (p < end) {
+                if (is_line_head) {
+                    is_line_head = false;
+                    const CharT* head = p;
+                    p = charscan::SkipSpace(p, end);
+                    if (p == end || starts_with(p, scan_single_note_opr) || starts_with(p, scan_multiline_note_lbracket_opr)) {
+                        continue;
+                    }
+                    //与GetToken相同的方式取第一个Token
+                    TokenType type = TokenType::Unknow;
+                    const CharT* q = p;
+                    if (IsSymbol(*p)) {
+                        q = p + token_table_.Match(p, (size_t)(end - p), &type);
+                    }
+                    else if (IsWord(*p)) {
+                        q = charscan::FindIdentEnd(p + 1, end);
+                        IsKeyOpr(string_view_type(p, (size_t)(q - p)), &type);
+                    }
+                    if (type == TokenType::Label || type == TokenType::DoubleColon) {
+                        const CharT* name = charscan::SkipSpace(q, end);
+                        if (name != end && IsWord(*name)) {
+                            const CharT* name_end = charscan::FindIdentEnd(name + 1, end);
+                            lines.push_back(LabelLine{ (size_t)(head - data), line, string_view_type(name, (size_t)(name_end - name)) });
+                        }
+                    }
+                    continue;
+                }
+
+                CharT c = *p;
+                if (c == 0) {
+                    break;
+                }
+                if (c == '\n') {
+                    ++line;
+                    ++p;
+                    is_line_head = true;
+                }
+                else if (c == scan_string_bracket) {
+                    //字符串中可以有换行，转义字符跳过下一个字符
+                    for (++p; p < end && *p != scan_string_bracket && *p != 0; ++p) {
+                        if (*p == scan_string_escape_char && p + 1 < end) {
+                            ++p;
+                        }
+                        if (*p == '\n') {
+                            ++line;
+                        }
+                    }
+                    if (p < end && *p == scan_string_bracket) {
+                        ++p;
+                    }
+                }
+                else if (c == single_note_head && starts_with(p, scan_single_note_opr)) {
+                    p = charscan::FindChar(p, end, (CharT)'\n');
+                }
+                else if (c == multiline_note_head && starts_with(p, scan_multiline_note_lbracket_opr)) {
+                    const string_type& rbracket = scan_multiline_note_rbracket_opr;
+                    const CharT* q = p + scan_multiline_note_lbracket_opr.length();
+                    while (q < end && !starts_with(q, rbracket)) {
+                        ++q;
+                    }
+                    line += (int)charscan::CountChar(p, q, (CharT)'\n');
+                    p = (std::min)(q + rbracket.length(), end);
+                }
+                else {
+                    ++p;
+                }
+            }
+            return lines;
+        }
+
+        template class BasicLexer<wchar_t>;
+        template class BasicLexer<char>;
+
+        TokenList Scanner(
+            wstring* code,
+            map<wstring, TokenType>* tokenList,
+            std::map<std::wstring, std::wstring>* escMap
+        ) {
+            Lexer lexer(*tokenList, *escMap);
+            return lexer.Scan(make_shared<const wstring>(*code));
+        }
+
 
         map<wstring, TokenType> get_std_operator_map() {
             map<wstring, TokenType> mp;
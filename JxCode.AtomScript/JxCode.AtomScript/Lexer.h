@@ -1,7 +1,10 @@
+#pragma once
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 #include "Token.h"
+#include "OperatorTable.h"
 #include "wexceptionbase.h"
 
 namespace jxcode
@@ -19,6 +22,13 @@ namespace jxcode
             virtual std::wstring what() override;
         };
 
+        //字符串或多行注释在源码结尾前没有闭合，分块分析时表示需要更多输入
+        class LexerUnexpectedEndException : public LexerException
+        {
+        public:
+            LexerUnexpectedEndException(const size_t& line, const size_t& pos_, const std::wstring& message);
+        };
+
 
         extern wchar_t scan_space;
         extern bool scan_is_parse_note;
@@ -31,7 +41,104 @@ namespace jxcode
         extern std::wstring scan_multiline_note_lbracket_opr;
         extern std::wstring scan_multiline_note_rbracket_opr;
 
-        std::vector<std::shared_ptr<Token>> Scanner(
+        //空白、标识符、注释使用批量扫描（SSE2/AVX2），关闭后逐字符处理
+        extern bool scan_vectorized;
+
+        //词法分析器实例，游标、配置与符号表都由实例持有，不同实例可在多线程中同时使用
+        //CharT为wchar_t时分析宽字符源码，为char时直接分析UTF-8源码
+        template<typename CharT>
+        class BasicLexer
+        {
+        public:
+            using string_type = std::basic_string<CharT>;
+            using string_view_type = std::basic_string_view<CharT>;
+            using token_type = BasicToken<CharT>;
+            using token_list_type = BasicTokenList<CharT>;
+            //以标签开头的行
+            struct LabelLine
+            {
+                size_t offset;  //行首位置
+                int line;       //从0开始的行号
+                string_view_type name;
+            };
+        public:
+            //构造时从全局scan_*配置复制
+            CharT scan_space;
+            bool scan_is_parse_note;
+            bool scan_is_parse_lf;
+
+            CharT scan_string_bracket;
+            CharT scan_string_escape_char;
+
+            string_type scan_single_note_opr;
+            string_type scan_multiline_note_lbracket_opr;
+            string_type scan_multiline_note_rbracket_opr;
+
+            bool scan_vectorized;
+        protected:
+            OperatorTable token_table_;
+            std::map<string_type, string_type> esc_char_map_;
+
+            const string_type* code_content_;
+            token_list_type* token_list_;
+            int cur_global_pos_;
+            int cur_line_;
+            int cur_position_;
+        public:
+            BasicLexer(
+                const OperatorTable& tokenTable,
+                const std::map<std::wstring, std::wstring>& escMap);
+            BasicLexer(
+                const std::map<std::wstring, TokenType>& tokenList,
+                const std::map<std::wstring, std::wstring>& escMap);
+        public:
+            token_list_type Scan(const std::shared_ptr<const string_type>& code);
+            //分析源码中的一块，code应在换行处截断，行号从first_line开始
+            //is_last为false时，跨越块结尾的字符串或注释所在的行会被回退，out_consumed返回已分析的长度
+            //out_is_end返回源码是否已结束（最后一块或遇到'\0'）
+            token_list_type ScanChunk(
+                const std::shared_ptr<const string_type>& code,
+                bool is_last,
+                int first_line,
+                size_t* out_consumed,
+                bool* out_is_end);
+            //预扫描，不生成Token，只找出以label或::开头的行，跳过字符串与注释，遇到'\0'时结束
+            std::vector<LabelLine> ScanLabelLines(const string_type& code) const;
+        protected:
+            void Reset();
+            CharT GetChar(int pos) const;
+            CharT GetChar() const;
+            CharT PeekChar(int offset = 1) const;
+            CharT NextChar();
+            void Next(int length);
+            //游标直接移动到pos，行号与列号按跨过的换行批量计算
+            void Advance(int pos);
+            void SkipSpace();
+
+            bool IsKeyOpr(string_view_type str, TokenType* out_type) const;
+            int GetCharType(const CharT& c) const;
+
+            bool is_cur_singleline_note() const;
+            bool is_cur_multiline_note() const;
+            bool is_curc_space() const;
+            bool is_curc_lf() const;
+            bool is_curc_symbol() const;
+            bool is_curc_null() const;
+            bool ShouldGetNumber() const;
+
+            string_view_type Substr(int pos, int length) const;
+            string_view_type GetNumber();
+            string_view_type GetString();
+            string_view_type GetSymbol(TokenType* type);
+            string_view_type GetIdent();
+            string_view_type GetNote();
+            bool GetToken(token_type* out_token);
+        };
+
+        using Lexer = BasicLexer<wchar_t>;
+        using Utf8Lexer = BasicLexer<char>;
+
+        TokenList Scanner(
             std::wstring* code,
             std::map<std::wstring, TokenType>* tokenList,
             std::map<std::wstring, std::wstring>* escMap
@@ -2,253 +2,305 @@
 #include <vector>
 #include <stdexcept>
 #include <sstream>
+#include <algorithm>
 
 namespace jxcode::atomscript
 {
     using namespace std;
     using namespace lexer;
 
-    OpCommand::OpCommand() : code(OpCode::Unknow), op_token(nullptr), targets(vector<shared_ptr<Token>>()) {
+    OpCommand::OpCommand() : code(OpCode::Unknow), op_token(), targets() {
 
     }
-    OpCommand::OpCommand(const OpCode& code, const shared_ptr<Token>& optoken, const vector<shared_ptr<Token>>& targets)
+    OpCommand::OpCommand(const OpCode& code, const Token& optoken, const TokenSpan& targets)
         : code(code), op_token(optoken), targets(targets)
     {
 
     }
 
-    static int cur_ptr;
-    static std::wstring* program_name;
-    static vector<shared_ptr<Token>>* tokens;
+    CommandList::CommandList()
+    {
+    }
 
-    inline static void Reset()
+    void CommandList::Reserve(size_t command_count, size_t operand_count)
     {
-        cur_ptr = -1;
-        tokens = nullptr;
+        this->commands.reserve(command_count);
+        if (operand_count <= this->operands_.capacity()) {
+            return;
+        }
+        //按倍数扩容，分块解析时多次追加不会反复复制
+        size_t capacity = (std::max)(operand_count, this->operands_.capacity() * 2);
+        vector<Token> buffer;
+        buffer.reserve(capacity);
+        buffer.insert(buffer.end(), this->operands_.begin(), this->operands_.end());
+        for (OpCommand& cmd : this->commands) {
+            if (!cmd.targets.empty()) {
+                size_t offset = cmd.targets.data() - this->operands_.data();
+                cmd.targets = TokenSpan(buffer.data() + offset, cmd.targets.size());
+            }
+        }
+        this->operands_.swap(buffer);
     }
 
-    inline static bool is_next()
+    const Token* CommandList::PushOperand(const Token& token)
     {
-        return (tokens != nullptr) && (cur_ptr < (int)tokens->size() - 1);
+        if (this->operands_.size() >= this->operands_.capacity()) {
+            throw std::logic_error("CommandList operand buffer overflow");
+        }
+        this->operands_.push_back(token);
+        return &this->operands_.back();
     }
-    inline static shared_ptr<Token> Peek(size_t count)
+
+    void CommandList::Append(const CommandList& other)
     {
-        if (cur_ptr + count >= tokens->size()) {
-            return nullptr;
+        this->Reserve(this->size() + other.size(), this->operand_count() + other.operand_count());
+        const Token* other_data = other.operands_.data();
+        const Token* data = this->operands_.data() + this->operands_.size();
+        this->operands_.insert(this->operands_.end(), other.operands_.begin(), other.operands_.end());
+        for (const OpCommand& cmd : other.commands) {
+            OpCommand item = cmd;
+            if (!item.targets.empty()) {
+                item.targets = TokenSpan(data + (item.targets.data() - other_data), item.targets.size());
+            }
+            this->commands.push_back(item);
         }
-        return tokens->at(cur_ptr + count);
     }
-    inline static bool PeekExist(int count)
+
+    //关键字只在命令开头有意义，作为操作数时还原为标识符
+    inline static bool IsKeyword(TokenType type)
     {
-        return (tokens != nullptr) && (cur_ptr + count < (int)tokens->size());
+        switch (type)
+        {
+        case TokenType::Call:
+        case TokenType::Goto:
+        case TokenType::If:
+        case TokenType::Then:
+        case TokenType::Var:
+        case TokenType::Set:
+        case TokenType::ClearSub:
+        case TokenType::Del:
+        case TokenType::ToProg:
+        case TokenType::Label:
+            return true;
+        default:
+            return false;
+        }
+    }
+    inline static Token ToOperand(const Token& token)
+    {
+        Token result = token;
+        if (IsKeyword(token.token_type)) {
+            result.token_type = TokenType::Ident;
+        }
+        return result;
     }
-    inline static shared_ptr<Token> cur_token()
+
+    CommandParser::CommandParser()
+        : tokens_(nullptr), program_name_(nullptr), cur_ptr_(-1)
     {
-        return tokens->at(cur_ptr);
     }
-    inline static shared_ptr<Token> NextToken(int offset = 1)
+
+    bool CommandParser::is_next() const
     {
-        if (!is_next()) {
+        return (this->tokens_ != nullptr) && (this->cur_ptr_ < (int)this->tokens_->size() - 1);
+    }
+    const Token* CommandParser::Peek(size_t count) const
+    {
+        if (this->cur_ptr_ + count >= this->tokens_->size()) {
             return nullptr;
         }
-        cur_ptr += offset;
-        return tokens->at(cur_ptr);
+        return &(*this->tokens_)[this->cur_ptr_ + count];
     }
-    inline static void NextLine()
+    const Token& CommandParser::cur_token() const
     {
-        while (is_next() && Peek(1)->token_type != TokenType::LF) {
-            NextToken();
+        return this->tokens_->at(this->cur_ptr_);
+    }
+    const Token* CommandParser::NextToken(int offset)
+    {
+        if (!this->is_next()) {
+            return nullptr;
         }
+        this->cur_ptr_ += offset;
+        return &this->tokens_->at(this->cur_ptr_);
     }
-    inline static void ThrowParameterException(bool bol) {
+    void CommandParser::ThrowParameterException(bool bol) const
+    {
         if (!bol) {
-            throw CommandParserException(cur_token(), L"OpParseParameterException");
+            throw CommandParserException(ToOperand(this->cur_token()), L"OpParseParameterException");
         }
     }
-    inline static void AssertAfterLength(int min, int max)
+    void CommandParser::AssertAfterLength(int min, int max) const
     {
         int count = 0;
 
         for (int i = 1; i <= max; i++)
         {
-            if (Peek(i) != nullptr && Peek(i)->token_type != TokenType::LF) {
+            const Token* token = this->Peek(i);
+            if (token != nullptr && token->token_type != TokenType::LF) {
                 ++count;
             }
         }
 
         if (count < min || count > max) {
-            throw CommandParserException(cur_token(), L"OpParseTargetRangeOut");
+            throw CommandParserException(ToOperand(this->cur_token()), L"OpParseTargetRangeOut");
         }
     }
-    inline static void AssertAfterLength(int count)
+    void CommandParser::AssertAfterLength(int count) const
     {
-        AssertAfterLength(count, count);
+        this->AssertAfterLength(count, count);
     }
 
-    inline static bool CheckValidPeek(int i, TokenType type)
+    bool CommandParser::CheckValidPeek(int i, TokenType type) const
     {
-        auto p = Peek(i);
+        auto p = this->Peek(i);
         if (p == nullptr) {
             return false;
         }
         return p->token_type == type;
     }
-    inline static bool CheckValidPeek(int i, const wstring& str)
+    bool CommandParser::CheckValidIdentPeek(int i) const
     {
-        auto p = Peek(i);
+        auto p = this->Peek(i);
         if (p == nullptr) {
             return false;
         }
-        return *p->value == str;
+        return p->token_type == TokenType::Ident || IsKeyword(p->token_type);
     }
 
-    inline static void AddRange(vector<shared_ptr<Token>>* tokens, int length) {
+    void CommandParser::AddRange(CommandList* list, int length)
+    {
         for (int i = 0; i < length; i++)
         {
-            tokens->push_back(NextToken());
+            list->PushOperand(ToOperand(*this->NextToken()));
         }
     }
-    inline static void AddRangeByEndType(vector<shared_ptr<Token>>* tokens, bool(*cb)(const shared_ptr<Token>& token))
+    void CommandParser::AddRangeToLF(CommandList* list)
     {
-        shared_ptr<Token> token;
-        for (int i = 1;; i++)
-        {
-            token = Peek(1);
-            if (token == nullptr || cb(token)) {
-                break;
-            }
-            tokens->push_back(token);
-            NextToken();
+        const Token* token;
+        while ((token = this->Peek(1)) != nullptr && token->token_type != TokenType::LF) {
+            list->PushOperand(ToOperand(*token));
+            this->NextToken();
         }
     }
-    inline static void AddRangeToLF(vector<shared_ptr<Token>>* tokens)
-    {
-        AddRangeByEndType(tokens, [](const shared_ptr<Token>& token)->bool { return token->token_type == TokenType::LF; });
-    }
 
-    std::shared_ptr<std::vector<OpCommand>> ParseOpList(std::wstring* _program_name, vector<shared_ptr<Token>>* _tokens)
+    void CommandParser::Parse(const wstring* program_name, const TokenList* tokens, CommandList* list)
     {
-        Reset();
-        program_name = _program_name;
-        tokens = _tokens;
-
-        using namespace jxcode::lexer;
-
-        static wstring opcode_call = L"call";
-        static wstring opcode_goto = L"goto";
-        static wstring opcode_if = L"if";
-        static wstring opcode_set = L"set";
-        static wstring opcode_clear = L"clearsub";
-        static wstring opcode_del = L"del";
-        static wstring opcode_jumpfile = L"toprog";
-        static wstring opcode_label = L"label";
+        this->program_name_ = program_name;
+        this->tokens_ = &tokens->tokens;
+        this->cur_ptr_ = -1;
 
-        shared_ptr<vector<OpCommand>> list = std::make_shared<vector<OpCommand>>();
+        //命令数不超过行数，操作数不超过Token数
+        size_t line_count = 1;
+        for (const Token& token : tokens->tokens) {
+            if (token.token_type == TokenType::LF) {
+                ++line_count;
+            }
+        }
+        list->Reserve(list->size() + line_count, list->operand_count() + tokens->tokens.size());
 
-        while (is_next()) {
+        while (this->is_next()) {
 
+            const Token* token = this->Peek(1);
+            TokenType type = token->token_type;
             OpCommand cmd = OpCommand();
+            cmd.op_token = ToOperand(*token);
 
-            shared_ptr<Token> token = Peek(1);
-            cmd.op_token = token;
+            size_t operand_begin = list->operand_count();
 
-            if (token->token_type == TokenType::LF) {
-                NextToken();
+            if (type == TokenType::LF) {
+                this->NextToken();
                 continue;
             }
-            else if (*token->value == opcode_call || token->token_type == TokenType::At) {
+            else if (type == TokenType::Call || type == TokenType::At) {
                 // call @
-                NextToken();
+                this->NextToken();
                 cmd.code = OpCode::Call;
-                AddRangeToLF(&cmd.targets);
-                NextToken(); //̻з
+                this->AddRangeToLF(list);
+                this->NextToken(); //吞换行符
             }
-            else if (*token->value == opcode_goto || token->token_type == TokenType::DoubleGreaterThan) {
+            else if (type == TokenType::Goto || type == TokenType::DoubleGreaterThan) {
                 // goto >>
-                NextToken();
-                AssertAfterLength(1, 2);
-                static wstring _var = L"var";
-                ThrowParameterException(
-                    (
-                    CheckValidPeek(1, TokenType::Ident) &&
-                    CheckValidPeek(1, _var) &&
-                    CheckValidPeek(2, TokenType::Ident)
-                ) ||
-                    CheckValidPeek(1, TokenType::Ident)
+                this->NextToken();
+                this->AssertAfterLength(1, 2);
+                this->ThrowParameterException(
+                    (this->CheckValidPeek(1, TokenType::Var) && this->CheckValidIdentPeek(2)) ||
+                    this->CheckValidIdentPeek(1)
                 );
 
                 cmd.code = OpCode::Goto;
 
-                auto var_token = NextToken();
-                cmd.targets.push_back(var_token);
-                //varһ
-                if (*var_token->value == _var) {
-                    cmd.targets.push_back(NextToken());
+                auto var_token = this->NextToken();
+                list->PushOperand(ToOperand(*var_token));
+                //如果有var在添加一个
+                if (var_token->token_type == TokenType::Var) {
+                    list->PushOperand(ToOperand(*this->NextToken()));
                 }
-                
             }
-            else if (*token->value == opcode_if || token->token_type == TokenType::Question) {
+            else if (type == TokenType::If || type == TokenType::Question) {
                 // if ?
-                NextToken();
+                this->NextToken();
                 cmd.code = OpCode::If;
-                AssertAfterLength(4);
-                ThrowParameterException(
-                    Peek(4)->token_type == TokenType::Ident &&
-                    *Peek(4)->value == L"then"
-                );
-                AddRange(&cmd.targets, 3);
-                NextToken(); // then
+                this->AssertAfterLength(4);
+                this->ThrowParameterException(this->Peek(4)->token_type == TokenType::Then);
+                this->AddRange(list, 3);
+                this->NextToken(); // 吞then
             }
-            else if (*token->value == opcode_set || token->token_type == TokenType::Doller) {
+            else if (type == TokenType::Set || type == TokenType::Doller) {
                 // set $
-                NextToken();
+                this->NextToken();
                 cmd.code = OpCode::Set;
-                AddRangeToLF(&cmd.targets);
-                NextToken(); //̻з
+                this->AddRangeToLF(list);
+                this->NextToken(); //吞换行符
             }
-            else if (*token->value == opcode_clear || token->token_type == TokenType::Tilde) {
+            else if (type == TokenType::ClearSub || type == TokenType::Tilde) {
                 // clear ~
-                NextToken();
-                AssertAfterLength(1);
-                ThrowParameterException(
-                    (CheckValidPeek(1, TokenType::Ident))
-                );
+                this->NextToken();
+                this->AssertAfterLength(1);
+                this->ThrowParameterException(this->CheckValidIdentPeek(1));
                 cmd.code = OpCode::ClearSub;
-                cmd.targets.push_back(NextToken());
+                this->AddRange(list, 1);
             }
-            else if (*token->value == opcode_del || token->token_type == TokenType::Division) {
+            else if (type == TokenType::Del || type == TokenType::Division) {
                 // del -
-                NextToken();
-                AssertAfterLength(1);
-                ThrowParameterException(
-                    (CheckValidPeek(1, TokenType::Ident))
-                );
+                this->NextToken();
+                this->AssertAfterLength(1);
+                this->ThrowParameterException(this->CheckValidIdentPeek(1));
                 cmd.code = OpCode::Del;
-                cmd.targets.push_back(NextToken());
+                this->AddRange(list, 1);
             }
-            else if (*token->value == opcode_jumpfile || token->token_type == TokenType::TripleGreaterThan) {
+            else if (type == TokenType::ToProg || type == TokenType::TripleGreaterThan) {
                 // jumpfile >>>
-                NextToken();
-                AssertAfterLength(1);
+                this->NextToken();
+                this->AssertAfterLength(1);
                 cmd.code = OpCode::ToProg;
-                cmd.targets.push_back(NextToken());
+                this->AddRange(list, 1);
             }
-            else if (*token->value == opcode_label || token->token_type == TokenType::DoubleColon) {
+            else if (type == TokenType::Label || type == TokenType::DoubleColon) {
                 // ::
-                NextToken();
-                AssertAfterLength(1);
-                ThrowParameterException(
-                    (CheckValidPeek(1, TokenType::Ident))
-                );
+                this->NextToken();
+                this->AssertAfterLength(1);
+                this->ThrowParameterException(this->CheckValidIdentPeek(1));
                 cmd.code = OpCode::Label;
-                cmd.targets.push_back(NextToken());
+                this->AddRange(list, 1);
             }
             else {
-                throw CommandParserException(token, L"Unknow");
+                throw CommandParserException(cmd.op_token, L"Unknow");
             }
 
-            list->push_back(cmd);
+            size_t operand_count = list->operand_count() - operand_begin;
+            if (operand_count != 0) {
+                cmd.targets = TokenSpan(list->operand_data(operand_begin), operand_count);
+            }
+            list->commands.push_back(cmd);
         }
+        this->tokens_ = nullptr;
+    }
+
+    std::shared_ptr<CommandList> ParseOpList(std::wstring* _program_name, const TokenList* _tokens)
+    {
+        auto list = std::make_shared<CommandList>();
+        CommandParser parser;
+        parser.Parse(_program_name, _tokens, list.get());
         return list;
     }
     std::wstring OpCommand::to_string() const
@@ -258,7 +310,7 @@ namespace jxcode::atomscript
         ss << (int)code;
         for (const auto& item : targets) {
             ss.width(18);
-            ss << *item->value;
+            ss << item.value;
         }
         return ss.str();
     }
@@ -268,7 +320,7 @@ namespace jxcode::atomscript
         return L"CommandParserException";
     }
 
-    CommandParserException::CommandParserException(const std::shared_ptr<Token>& token, const std::wstring& message)
+    CommandParserException::CommandParserException(const Token& token, const std::wstring& message)
         : TokenException(token, message)
     {
     }
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <memory>
 #include "Token.h"
 
 namespace jxcode::atomscript
@@ -17,31 +18,106 @@ namespace jxcode::atomscript
         ClearSub,
         ToProg,
     };
-    struct OpCommand 
+
+    //CommandList操作数缓冲区中的一段连续Token
+    class TokenSpan
+    {
+    protected:
+        const lexer::Token* data_;
+        size_t size_;
+    public:
+        TokenSpan() : data_(nullptr), size_(0) {}
+        TokenSpan(const lexer::Token* data, size_t size) : data_(data), size_(size) {}
+    public:
+        const lexer::Token* data() const { return this->data_; }
+        size_t size() const { return this->size_; }
+        bool empty() const { return this->size_ == 0; }
+        const lexer::Token& operator[](size_t index) const { return this->data_[index]; }
+        const lexer::Token* begin() const { return this->data_; }
+        const lexer::Token* end() const { return this->data_ + this->size_; }
+    };
+
+    struct OpCommand
     {
         OpCode code;
-        std::shared_ptr<lexer::Token> op_token;
-        std::vector<std::shared_ptr<lexer::Token>> targets;
+        lexer::Token op_token;
+        TokenSpan targets;
 
         OpCommand();
         OpCommand(
             const OpCode& code,
-            const std::shared_ptr<lexer::Token>& optoken, 
-            const std::vector<std::shared_ptr<lexer::Token>>& targets);
+            const lexer::Token& optoken,
+            const TokenSpan& targets);
 
         std::wstring to_string() const;
     };
 
+    //命令集，所有命令的操作数保存在同一个连续缓冲区中
+    //命令中的Token引用词法分析的TokenList，TokenList需要与命令集同时存活
+    class CommandList
+    {
+    public:
+        std::vector<OpCommand> commands;
+    protected:
+        std::vector<lexer::Token> operands_;
+    public:
+        CommandList();
+        CommandList(const CommandList&) = delete;
+        CommandList(CommandList&&) = default;
+        CommandList& operator=(const CommandList&) = delete;
+        CommandList& operator=(CommandList&&) = default;
+    public:
+        size_t size() const { return this->commands.size(); }
+        const OpCommand& at(size_t index) const { return this->commands.at(index); }
+        const OpCommand& operator[](size_t index) const { return this->commands[index]; }
+        //预留操作数缓冲区，扩容时已有命令的targets会指向新的缓冲区
+        void Reserve(size_t command_count, size_t operand_count);
+        //在缓冲区尾部追加操作数，调用前需要Reserve足够的空间
+        const lexer::Token* PushOperand(const lexer::Token& token);
+        size_t operand_count() const { return this->operands_.size(); }
+        const lexer::Token* operand_data(size_t index) const { return this->operands_.data() + index; }
+        //把other的命令追加到尾部，操作数复制到本对象的缓冲区
+        void Append(const CommandList& other);
+    };
+
     class CommandParserException : public lexer::TokenException
     {
     protected:
         std::wstring get_name() override;
     public:
-        CommandParserException(const std::shared_ptr<lexer::Token>& token, const std::wstring& message);
+        CommandParserException(const lexer::Token& token, const std::wstring& message);
+    };
+
+    //命令解析器，解析状态由实例持有，不同实例可在多线程中同时使用
+    //关键字在词法分析时已经分类为TokenType，操作数中的关键字会还原为Ident
+    class CommandParser
+    {
+    protected:
+        const std::vector<lexer::Token>* tokens_;
+        const std::wstring* program_name_;
+        int cur_ptr_;
+    public:
+        CommandParser();
+    public:
+        //解析tokens并把命令追加到list
+        void Parse(const std::wstring* program_name, const lexer::TokenList* tokens, CommandList* list);
+    protected:
+        bool is_next() const;
+        const lexer::Token* Peek(size_t count) const;
+        const lexer::Token& cur_token() const;
+        const lexer::Token* NextToken(int offset = 1);
+        void ThrowParameterException(bool bol) const;
+        void AssertAfterLength(int min, int max) const;
+        void AssertAfterLength(int count) const;
+        bool CheckValidPeek(int i, lexer::TokenType type) const;
+        bool CheckValidIdentPeek(int i) const;
+        void AddRange(CommandList* list, int length);
+        void AddRangeToLF(CommandList* list);
     };
 
-    std::shared_ptr<std::vector<OpCommand>> ParseOpList(
-        std::wstring* program_name, 
-        std::vector<std::shared_ptr<lexer::Token>>* _tokens);
+    //OpCommand中的Token引用_tokens的缓冲区，_tokens需要与返回的命令集同时存活
+    std::shared_ptr<CommandList> ParseOpList(
+        std::wstring* program_name,
+        const lexer::TokenList* _tokens);
 
-}
\ No newline at end of file
+}
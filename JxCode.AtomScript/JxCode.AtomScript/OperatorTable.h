@@ -0,0 +1,159 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <map>
+#include <stdexcept>
+#include <type_traits>
+#include "Token.h"
+
+namespace jxcode::lexer
+{
+    struct OperatorDef
+    {
+        const wchar_t* text;
+        TokenType type;
+    };
+
+    //运算符与关键字表，按首字符分桶，桶内按长度降序排列，第一个完整匹配即为最长匹配
+    //可以在编译期由OperatorDef数组构造，匹配过程不产生任何分配
+    class OperatorTable
+    {
+    public:
+        static constexpr size_t kMaxEntries = 64;
+        static constexpr size_t kMaxLength = 8;
+        static constexpr size_t kBucketCount = 128;
+    protected:
+        struct Entry
+        {
+            wchar_t text[kMaxLength] = {};
+            size_t length = 0;
+            TokenType type = TokenType::Unknow;
+        };
+        Entry entries_[kMaxEntries] = {};
+        uint8_t bucket_begin_[kBucketCount] = {};
+        uint8_t bucket_end_[kBucketCount] = {};
+        size_t size_ = 0;
+    public:
+        constexpr OperatorTable() {}
+
+        template<size_t N>
+        constexpr OperatorTable(const OperatorDef(&defs)[N])
+        {
+            static_assert(N <= kMaxEntries, "too many operators");
+            for (size_t i = 0; i < N; i++) {
+                this->Add(defs[i].text, defs[i].type);
+            }
+            this->Build();
+        }
+
+        explicit OperatorTable(const std::map<std::wstring, TokenType>& mp)
+        {
+            for (auto& item : mp) {
+                if (item.first.empty() || item.first.length() > kMaxLength
+                    || (size_t)item.first[0] >= kBucketCount || this->size_ >= kMaxEntries) {
+                    throw std::length_error("operator table entry out of range");
+                }
+                this->Add(item.first.c_str(), item.second);
+            }
+            this->Build();
+        }
+
+        constexpr size_t size() const { return this->size_; }
+
+        //返回从str开始能匹配到的最长运算符长度，无匹配返回0
+        //CharT可以是wchar_t或UTF-8的char，运算符只包含ASCII字符
+        template<typename CharT>
+        constexpr size_t Match(const CharT* str, size_t length, TokenType* out_type) const
+        {
+            if (length == 0 || CodeOf(str[0]) >= kBucketCount) {
+                return 0;
+            }
+            size_t bucket = CodeOf(str[0]);
+            for (size_t i = this->bucket_begin_[bucket]; i < this->bucket_end_[bucket]; i++) {
+                const Entry& entry = this->entries_[i];
+                if (entry.length <= length && Equals(entry, str)) {
+                    *out_type = entry.type;
+                    return entry.length;
+                }
+            }
+            return 0;
+        }
+
+        //完整匹配，用于标识符是否为关键字
+        template<typename CharT>
+        constexpr bool Find(const CharT* str, size_t length, TokenType* out_type) const
+        {
+            if (length == 0 || length > kMaxLength || CodeOf(str[0]) >= kBucketCount) {
+                return false;
+            }
+            size_t bucket = CodeOf(str[0]);
+            for (size_t i = this->bucket_begin_[bucket]; i < this->bucket_end_[bucket]; i++) {
+                const Entry& entry = this->entries_[i];
+                if (entry.length == length && Equals(entry, str)) {
+                    *out_type = entry.type;
+                    return true;
+                }
+            }
+            return false;
+        }
+    protected:
+        template<typename CharT>
+        static constexpr size_t CodeOf(CharT c)
+        {
+            return (size_t)(std::make_unsigned_t<CharT>)c;
+        }
+
+        template<typename CharT>
+        static constexpr bool Equals(const Entry& entry, const CharT* str)
+        {
+            for (size_t i = 0; i < entry.length; i++) {
+                if ((size_t)entry.text[i] != CodeOf(str[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        constexpr void Add(const wchar_t* text, TokenType type)
+        {
+            Entry& entry = this->entries_[this->size_++];
+            size_t len = 0;
+            while (text[len] != 0 && len < kMaxLength) {
+                entry.text[len] = text[len];
+                ++len;
+            }
+            entry.length = len;
+            entry.type = type;
+        }
+
+        constexpr void Build()
+        {
+            //插入排序：首字符升序，长度降序
+            for (size_t i = 1; i < this->size_; i++) {
+                Entry item = this->entries_[i];
+                size_t j = i;
+                while (j > 0 && Less(item, this->entries_[j - 1])) {
+                    this->entries_[j] = this->entries_[j - 1];
+                    --j;
+                }
+                this->entries_[j] = item;
+            }
+            for (size_t i = 0; i < this->size_; i++) {
+                size_t bucket = (size_t)this->entries_[i].text[0];
+                if (this->bucket_end_[bucket] == 0) {
+                    this->bucket_begin_[bucket] = (uint8_t)i;
+                }
+                this->bucket_end_[bucket] = (uint8_t)(i + 1);
+            }
+        }
+
+        static constexpr bool Less(const Entry& x, const Entry& y)
+        {
+            if (x.text[0] != y.text[0]) {
+                return x.text[0] < y.text[0];
+            }
+            return x.length > y.length;
+        }
+    };
+}
@@ -0,0 +1,440 @@
+#include "Optimizer.h"
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+namespace jxcode::atomscript
+{
+    using namespace std;
+    using namespace lexer;
+
+    //变量槽位到已知字面值，不在表中的变量值未知
+    using ConstMap = map<int32_t, Operand>;
+    //有序的变量槽位
+    using DeadSet = vector<int32_t>;
+
+    //后继为程序结尾
+    static constexpr int32_t kExitBlock = -1;
+
+    struct BasicBlock
+    {
+        int32_t begin;
+        int32_t end;
+        int32_t succ[2];
+        int32_t succ_count;
+        bool is_root;      //程序开头与标签，可能从外部进入
+        bool is_reachable;
+    };
+
+    struct ControlFlowGraph
+    {
+        vector<BasicBlock> blocks;
+        vector<int32_t> block_of; //指令所在的块，程序结尾为kExitBlock
+    };
+
+    inline static bool IsLabel(const Instruction& ins)
+    {
+        return ins.cmd != nullptr && ins.cmd->code == OpCode::Label;
+    }
+
+    inline static bool IsLiteral(const Operand& op)
+    {
+        return op.kind == OperandKind::Number || op.kind == OperandKind::String;
+    }
+
+    //执行时宿主可以读写变量，或者可能抛出异常把当前状态交给宿主
+    static bool IsEscape(const Instruction& ins)
+    {
+        switch (ins.code)
+        {
+        case InstrCode::Call:
+        case InstrCode::GotoVar:
+        case InstrCode::ToProg:
+        case InstrCode::Error:
+            return true;
+        case InstrCode::Set:
+            //来源变量未定义时抛出异常
+            return ins.y.kind == OperandKind::Ident || ins.y.kind == OperandKind::NumberText;
+        case InstrCode::If:
+            return ins.x.kind == OperandKind::NumberText || ins.y.kind == OperandKind::NumberText;
+        default:
+            return false;
+        }
+    }
+
+    static ControlFlowGraph BuildGraph(const Program& program, int32_t count)
+    {
+        const vector<Instruction>& code = program.code;
+
+        //If不成立时跳过一行，目标可能是count+1
+        vector<bool> is_leader(count + 2, false);
+        is_leader[0] = true;
+        for (int32_t i = 0; i < count; i++) {
+            const Instruction& ins = code[i];
+            if (IsLabel(ins)) {
+                is_leader[i] = true;
+            }
+            switch (ins.code)
+            {
+            case InstrCode::Goto:
+                is_leader[ins.jump + 1] = true;
+                is_leader[i + 1] = true;
+                break;
+            case InstrCode::If:
+                is_leader[i + 1] = true;
+                is_leader[i + 2] = true;
+                break;
+            case InstrCode::GotoVar:
+            case InstrCode::ToProg:
+            case InstrCode::Error:
+                is_leader[i + 1] = true;
+                break;
+            default:
+                break;
+            }
+        }
+
+        ControlFlowGraph graph;
+        graph.block_of.assign(count + 2, kExitBlock);
+        for (int32_t i = 0; i < count; i++) {
+            if (is_leader[i]) {
+                BasicBlock block{ i, i + 1, { kExitBlock, kExitBlock }, 0, false, false };
+                block.is_root = i == 0 || IsLabel(code[i]);
+                graph.blocks.push_back(block);
+            }
+            else {
+                graph.blocks.back().end = i + 1;
+            }
+            graph.block_of[i] = (int32_t)graph.blocks.size() - 1;
+        }
+
+        for (BasicBlock& block : graph.blocks) {
+            const Instruction& last = code[block.end - 1];
+            auto add = [&](int32_t target) {
+                block.succ[block.succ_count++] = graph.block_of[target];
+            };
+            switch (last.code)
+            {
+            case InstrCode::Goto:
+                add(last.jump + 1);
+                break;
+            case InstrCode::If:
+                add(block.end);
+                add(block.end + 1);
+                break;
+            case InstrCode::GotoVar:
+                //目标是某个标签，标签都是根
+            case InstrCode::ToProg:
+                break;
+            default:
+                //Error抛出前已保存执行位置，宿主捕获后再次执行时从下一行继续
+                add(block.end);
+                break;
+            }
+        }
+        return graph;
+    }
+
+    //宿主可以随时跳转到任意标签，所以从开头和所有标签出发
+    static void MarkReachable(ControlFlowGraph* graph)
+    {
+        vector<BasicBlock>& blocks = graph->blocks;
+        vector<int32_t> stack;
+        for (int32_t b = 0; b < (int32_t)blocks.size(); b++) {
+            if (blocks[b].is_root) {
+                blocks[b].is_reachable = true;
+                stack.push_back(b);
+            }
+        }
+        while (!stack.empty()) {
+            const BasicBlock& block = blocks[stack.back()];
+            stack.pop_back();
+            for (int32_t k = 0; k < block.succ_count; k++) {
+                int32_t s = block.succ[k];
+                if (s != kExitBlock && !blocks[s].is_reachable) {
+                    blocks[s].is_reachable = true;
+                    stack.push_back(s);
+                }
+            }
+        }
+    }
+
+    inline static Operand Resolve(const Operand& op, const ConstMap& consts)
+    {
+        if (op.kind == OperandKind::Ident) {
+            auto it = consts.find(op.slot);
+            if (it != consts.end()) {
+                return it->second;
+            }
+        }
+        return op;
+    }
+
+    //执行后还能继续执行下一条
+    inline static bool IsFallThrough(const Instruction& ins)
+    {
+        switch (ins.code)
+        {
+        case InstrCode::Goto:
+        case InstrCode::GotoVar:
+        case InstrCode::ToProg:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    //代入常量并更新常量表
+    static void PropagateInstruction(Program* program, Instruction* ins, ConstMap* consts)
+    {
+        switch (ins->code)
+        {
+        case InstrCode::If:
+            ins->x = Resolve(ins->x, *consts);
+            ins->y = Resolve(ins->y, *consts);
+            break;
+        case InstrCode::Set:
+            ins->y = Resolve(ins->y, *consts);
+            if (IsLiteral(ins->y)) {
+                (*consts)[ins->x.slot] = ins->y;
+            }
+            else {
+                consts->erase(ins->x.slot);
+            }
+            break;
+        case InstrCode::Del:
+            consts->erase(ins->x.slot);
+            break;
+        case InstrCode::Call:
+        {
+            CallSite& site = program->call_sites[ins->jump];
+            for (Operand& arg : site.static_call.args) {
+                arg = Resolve(arg, *consts);
+            }
+            for (Operand& arg : site.instance_call.args) {
+                arg = Resolve(arg, *consts);
+            }
+            //宿主与内置库可能修改任何变量
+            consts->clear();
+            break;
+        }
+        case InstrCode::ClearSub:
+        case InstrCode::Error:
+            //宿主捕获异常后可能修改变量再继续执行
+            consts->clear();
+            break;
+        default:
+            break;
+        }
+    }
+
+    //按顺序扫描一遍即可得到每条指令处的常量：
+    //标签与跳转目标的入口没有常量，其余指令只能从上一行顺序执行或被前两行的If跳过到达，
+    //被跳过时入口是两条路径的交集，也就是去掉被跳过的那一行写入的变量
+    static void PropagateConstants(Program* program, int32_t count)
+    {
+        vector<Instruction>& code = program->code;
+        vector<bool> is_target(count + 2, false);
+        for (int32_t i = 0; i < count; i++) {
+            if (code[i].code == InstrCode::Goto) {
+                is_target[code[i].jump + 1] = true;
+            }
+        }
+
+        ConstMap consts;
+        for (int32_t i = 0; i < count; i++) {
+            Instruction& ins = code[i];
+            bool is_fall = i >= 1 && IsFallThrough(code[i - 1]);
+            bool is_skip = i >= 2 && code[i - 2].code == InstrCode::If;
+
+            if (i == 0 || IsLabel(ins) || is_target[i] || (!is_fall && !is_skip)) {
+                consts.clear();
+            }
+            else if (is_fall && is_skip) {
+                const Instruction& skipped = code[i - 1];
+                if (skipped.code == InstrCode::Set || skipped.code == InstrCode::Del) {
+                    consts.erase(skipped.x.slot);
+                }
+            }
+            PropagateInstruction(program, &ins, &consts);
+        }
+    }
+
+    //与执行时的VariableOperate一致，类型不同时不成立
+    static bool CompareLiterals(const Program& program, TokenType compare, const Operand& x, const Operand& y)
+    {
+        if (x.kind != y.kind) {
+            return false;
+        }
+        if (x.kind == OperandKind::Number) {
+            return NumberCompare(compare, x.num, y.num);
+        }
+        //相同内容的字符串共用同一个指针，比较内容即可
+        bool is_equal = program.strings[x.str] == program.strings[y.str];
+        if (compare == TokenType::DoubleEqual) {
+            return is_equal;
+        }
+        else if (compare == TokenType::ExclamatoryAndEqual) {
+            return !is_equal;
+        }
+        return false;
+    }
+
+    //两侧都是字面值的If，成立时改为Nop，不成立时改为跳过下一行的Goto
+    static void FoldBranches(Program* program, int32_t count)
+    {
+        for (int32_t i = 0; i < count; i++) {
+            Instruction& ins = program->code[i];
+            if (ins.code != InstrCode::If || !IsLiteral(ins.x) || !IsLiteral(ins.y)) {
+                continue;
+            }
+            if (CompareLiterals(*program, ins.compare, ins.x, ins.y)) {
+                ins.code = InstrCode::Nop;
+            }
+            else {
+                ins.code = InstrCode::Goto;
+                ins.jump = i + 1;
+            }
+        }
+    }
+
+    static void RemoveUnreachable(Program* program, const ControlFlowGraph& graph)
+    {
+        for (const BasicBlock& block : graph.blocks) {
+            if (block.is_reachable) {
+                continue;
+            }
+            for (int32_t i = block.begin; i < block.end; i++) {
+                program->code[i].code = InstrCode::Nop;
+            }
+        }
+    }
+
+    inline static bool Contains(const DeadSet& dead, int32_t slot)
+    {
+        return std::binary_search(dead.begin(), dead.end(), slot);
+    }
+
+    inline static void Insert(DeadSet* dead, int32_t slot)
+    {
+        auto it = std::lower_bound(dead->begin(), dead->end(), slot);
+        if (it == dead->end() || *it != slot) {
+            dead->insert(it, slot);
+        }
+    }
+
+    inline static void Erase(DeadSet* dead, const Operand& op)
+    {
+        if (op.kind != OperandKind::Ident) {
+            return;
+        }
+        auto it = std::lower_bound(dead->begin(), dead->end(), op.slot);
+        if (it != dead->end() && *it == op.slot) {
+            dead->erase(it);
+        }
+    }
+
+    //由指令之后的死变量求指令之前的死变量
+    static void DeadTransfer(const Instruction& ins, DeadSet* dead)
+    {
+        if (IsEscape(ins)) {
+            dead->clear();
+            return;
+        }
+        switch (ins.code)
+        {
+        case InstrCode::If:
+            Erase(dead, ins.x);
+            Erase(dead, ins.y);
+            break;
+        case InstrCode::Set:
+            Insert(dead, ins.x.slot);
+            Erase(dead, ins.y);
+            break;
+        case InstrCode::Del:
+            Insert(dead, ins.x.slot);
+            break;
+        default:
+            break;
+        }
+    }
+
+    //活跃变量通常远多于死变量，所以记录在被读取前一定会被覆盖的变量
+    //从所有变量都活跃开始迭代，每一步的结果都是安全的
+    static void EliminateDeadStores(Program* program, const ControlFlowGraph& graph)
+    {
+        const vector<BasicBlock>& blocks = graph.blocks;
+        vector<DeadSet> dead_in(blocks.size());
+
+        //程序结束后变量仍然保留，结尾处没有死变量
+        auto dead_out = [&](const BasicBlock& block) {
+            DeadSet dead;
+            for (int32_t k = 0; k < block.succ_count; k++) {
+                int32_t s = block.succ[k];
+                if (s == kExitBlock) {
+                    return DeadSet();
+                }
+                if (k == 0) {
+                    dead = dead_in[s];
+                }
+                else {
+                    DeadSet both;
+                    std::set_intersection(dead.begin(), dead.end(), dead_in[s].begin(), dead_in[s].end(), std::back_inserter(both));
+                    dead = std::move(both);
+                }
+            }
+            return dead;
+        };
+
+        bool is_changed = true;
+        while (is_changed) {
+            is_changed = false;
+            for (int32_t b = (int32_t)blocks.size() - 1; b >= 0; b--) {
+                const BasicBlock& block = blocks[b];
+                if (!block.is_reachable) {
+                    continue;
+                }
+                DeadSet dead = dead_out(block);
+                for (int32_t i = block.end - 1; i >= block.begin; i--) {
+                    DeadTransfer(program->code[i], &dead);
+                }
+                if (dead != dead_in[b]) {
+                    dead_in[b] = std::move(dead);
+                    is_changed = true;
+                }
+            }
+        }
+
+        for (const BasicBlock& block : blocks) {
+            if (!block.is_reachable) {
+                continue;
+            }
+            DeadSet dead = dead_out(block);
+            for (int32_t i = block.end - 1; i >= block.begin; i--) {
+                Instruction& ins = program->code[i];
+                if (ins.code == InstrCode::Set && IsLiteral(ins.y) && Contains(dead, ins.x.slot)) {
+                    ins.code = InstrCode::Nop;
+                    continue;
+                }
+                DeadTransfer(ins, &dead);
+            }
+        }
+    }
+
+    void OptimizeProgram(Program* program, size_t count)
+    {
+        int32_t n = (int32_t)count;
+        if (n == 0) {
+            return;
+        }
+        PropagateConstants(program, n);
+        FoldBranches(program, n);
+
+        ControlFlowGraph graph = BuildGraph(*program, n);
+        MarkReachable(&graph);
+        RemoveUnreachable(program, graph);
+        EliminateDeadStores(program, graph);
+    }
+}
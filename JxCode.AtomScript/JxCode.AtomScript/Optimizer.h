@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+#include "Bytecode.h"
+
+namespace jxcode::atomscript
+{
+    //可选的数据流优化，作用于前count条指令，指令数与下标不变，删除的指令替换为Nop
+    //  常量传播：已知为字面值的变量代入If比较与调用参数，两侧都是字面值的If在加载时求值
+    //  删除不可达块：无条件跳转之后、下一个标签之前的代码
+    //  删除死存储：在被读取前就被覆盖的字面值赋值
+    //标签可能被宿主或goto var跳转到达，进入标签时不假设任何常量；
+    //宿主调用、toprog、可能抛出异常的指令与程序结尾处认为所有变量都会被读取
+    void OptimizeProgram(Program* program, size_t count);
+}
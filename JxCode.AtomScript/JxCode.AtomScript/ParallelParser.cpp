@@ -0,0 +1,145 @@
+#include "ParallelParser.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "CharScan.h"
+
+namespace jxcode::atomscript
+{
+    using namespace std;
+    using namespace lexer;
+
+    inline static TokenList ToWideTokens(TokenList&& tokens)
+    {
+        return std::move(tokens);
+    }
+    inline static TokenList ToWideTokens(Utf8TokenList&& tokens)
+    {
+        return WidenTokenList(tokens);
+    }
+
+    template<typename CharT>
+    BasicParallelParser<CharT>::BasicParallelParser(
+        const BasicLexer<CharT>* lexer,
+        wstring* program_name,
+        size_t thread_count)
+        : lexer_(lexer), program_name_(program_name), thread_count_(thread_count)
+    {
+        if (this->thread_count_ == 0) {
+            this->thread_count_ = (std::max)(std::thread::hardware_concurrency(), 1u);
+        }
+    }
+
+    template<typename CharT>
+    void BasicParallelParser<CharT>::ParseChunk(Chunk* chunk, BasicLexer<CharT>* lexer, CommandParser* parser) const
+    {
+        auto chunk_tokens = lexer->ScanChunk(chunk->code, chunk->is_last, chunk->first_line, &chunk->consumed, &chunk->is_end);
+        chunk->tokens = ToWideTokens(std::move(chunk_tokens));
+        parser->Parse(this->program_name_, &chunk->tokens, &chunk->commands);
+    }
+
+    template<typename CharT>
+    void BasicParallelParser<CharT>::Parse(
+        const shared_ptr<const basic_string<CharT>>& code,
+        TokenList* tokens,
+        CommandList* commands)
+    {
+        const CharT* data = code->data();
+        size_t length = code->length();
+
+        //每个线程分几块，块大小不均时后面的块可以交给先完成的线程
+        size_t chunk_count = (std::min)(this->thread_count_ * 4, length / kMinChunkSize);
+
+        vector<Chunk> chunks;
+        if (chunk_count <= 1) {
+            Chunk chunk;
+            chunk.code = code;
+            chunk.first_line = 0;
+            chunk.is_last = true;
+            chunks.push_back(std::move(chunk));
+        }
+        else {
+            //在目标位置之后的第一个换行处切分
+            chunks.reserve(chunk_count);
+            size_t target = length / chunk_count;
+            size_t begin = 0;
+            int line = 0;
+            while (begin < length) {
+                size_t end = length;
+                if (chunks.size() + 1 < chunk_count) {
+                    const CharT* p = charscan::FindChar(data + (std::min)(begin + target, length), data + length, (CharT)'\n');
+                    end = (p == data + length) ? length : (size_t)(p - data) + 1;
+                }
+                Chunk chunk;
+                chunk.code = make_shared<const basic_string<CharT>>(*code, begin, end - begin);
+                chunk.first_line = line;
+                chunk.is_last = end == length;
+                chunks.push_back(std::move(chunk));
+
+                line += (int)charscan::CountChar(data + begin, data + end, (CharT)'\n');
+                begin = end;
+            }
+        }
+
+        //每个线程使用自己的词法分析器与解析器
+        atomic<size_t> next_index(0);
+        auto work = [this, &chunks, &next_index]() {
+            BasicLexer<CharT> lexer = *this->lexer_;
+            CommandParser parser;
+            size_t index;
+            while ((index = next_index++) < chunks.size()) {
+                try {
+                    this->ParseChunk(&chunks[index], &lexer, &parser);
+                }
+                catch (...) {
+                    chunks[index].error = current_exception();
+                }
+            }
+        };
+        vector<thread> workers;
+        size_t worker_count = (std::min)(this->thread_count_, chunks.size());
+        for (size_t i = 1; i < worker_count; i++) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        //按顺序拼接，carry不为空时下一块的结果作废
+        BasicLexer<CharT> lexer = *this->lexer_;
+        CommandParser parser;
+        basic_string<CharT> carry;
+        int carry_line = 0;
+        for (Chunk& chunk : chunks) {
+            if (!carry.empty()) {
+                Chunk merged;
+                merged.code = make_shared<const basic_string<CharT>>(carry + *chunk.code);
+                merged.first_line = carry_line;
+                merged.is_last = chunk.is_last;
+                chunk = std::move(merged);
+                this->ParseChunk(&chunk, &lexer, &parser);
+                carry.clear();
+            }
+            else if (chunk.error) {
+                rethrow_exception(chunk.error);
+            }
+
+            commands->Append(chunk.commands);
+            tokens->Append(std::move(chunk.tokens));
+            if (chunk.is_end) {
+                break;
+            }
+            if (chunk.consumed < chunk.code->length()) {
+                const CharT* chunk_data = chunk.code->data();
+                carry.assign(*chunk.code, chunk.consumed, basic_string<CharT>::npos);
+                carry_line = chunk.first_line + (int)charscan::CountChar(chunk_data, chunk_data + chunk.consumed, (CharT)'\n');
+            }
+            chunk.code.reset();
+            chunk.commands = CommandList();
+        }
+    }
+
+    template class BasicParallelParser<wchar_t>;
+    template class BasicParallelParser<char>;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include "Token.h"
+#include "Lexer.h"
+#include "OpCommand.h"
+
+namespace jxcode::atomscript
+{
+    //把源码在换行处切分为多块，在多个线程中并行词法分析与解析，再按顺序拼接命令
+    //每块假设从行首开始分析；若前一块结尾处于未闭合的字符串或注释中，
+    //则说明这一块的分析结果无效，拼接时把前一块剩余部分与这一块合并后重新分析
+    template<typename CharT>
+    class BasicParallelParser
+    {
+    public:
+        //小于此长度的块不再切分
+        static constexpr size_t kMinChunkSize = 256 * 1024;
+    protected:
+        struct Chunk
+        {
+            std::shared_ptr<const std::basic_string<CharT>> code;
+            int first_line = 0;
+            bool is_last = false;
+
+            lexer::TokenList tokens;
+            CommandList commands;
+            size_t consumed = 0;
+            bool is_end = false;
+            std::exception_ptr error;
+        };
+    protected:
+        const lexer::BasicLexer<CharT>* lexer_;
+        std::wstring* program_name_;
+        size_t thread_count_;
+    public:
+        //thread_count为0时使用硬件线程数
+        BasicParallelParser(
+            const lexer::BasicLexer<CharT>* lexer,
+            std::wstring* program_name,
+            size_t thread_count = 0);
+    public:
+        //命令追加到commands，命令中Token引用的缓冲区由tokens持有
+        void Parse(
+            const std::shared_ptr<const std::basic_string<CharT>>& code,
+            lexer::TokenList* tokens,
+            CommandList* commands);
+    protected:
+        void ParseChunk(Chunk* chunk, lexer::BasicLexer<CharT>* lexer, CommandParser* parser) const;
+    };
+
+    using ParallelParser = BasicParallelParser<wchar_t>;
+    using Utf8ParallelParser = BasicParallelParser<char>;
+}
@@ -0,0 +1,143 @@
+#include "ProgramCache.h"
+#include <tuple>
+
+namespace jxcode::atomscript
+{
+    using namespace std;
+    using namespace lexer;
+
+    size_t CompiledProgram::memory_size() const
+    {
+        size_t size = sizeof(CompiledProgram);
+        if (this->tokens) {
+            if (this->tokens->source) {
+                size += this->tokens->source->size() * sizeof(wchar_t);
+            }
+            else {
+                //值保存在TokenList的字符串存储中
+                for (const Token& token : this->tokens->tokens) {
+                    size += token.value.size() * sizeof(wchar_t);
+                }
+            }
+            size += this->tokens->tokens.size() * sizeof(Token);
+        }
+        if (this->commands) {
+            size += this->commands->size() * sizeof(OpCommand);
+        }
+        size += this->program.code.size() * sizeof(Instruction);
+        size += this->program.call_sites.size() * sizeof(CallSite);
+        for (wstring_view str : this->program.strings) {
+            size += str.size() * sizeof(wchar_t);
+        }
+        for (const wstring& name : this->symbols) {
+            size += sizeof(wstring) + name.size() * sizeof(wchar_t);
+        }
+        return size;
+    }
+
+    Program CompiledProgram::Link(SymbolTable* symbols) const
+    {
+        vector<int32_t> slots(this->symbols.size());
+        for (size_t i = 0; i < this->symbols.size(); i++) {
+            slots[i] = symbols->Intern(this->symbols[i]);
+        }
+        return RemapSlots(this->program, slots);
+    }
+
+    bool ProgramCache::Key::operator<(const Key& other) const
+    {
+        return tie(this->program_name, this->source_hash, this->is_optimize)
+            < tie(other.program_name, other.source_hash, other.is_optimize);
+    }
+
+    ProgramCache::ProgramCache(size_t capacity)
+        : capacity_(capacity), size_(0)
+    {
+    }
+
+    shared_ptr<const CompiledProgram> ProgramCache::Find(const Key& key)
+    {
+        lock_guard<mutex> lock(this->mutex_);
+        auto it = this->index_.find(key);
+        if (it == this->index_.end()) {
+            return nullptr;
+        }
+        this->entries_.splice(this->entries_.begin(), this->entries_, it->second);
+        return it->second->program;
+    }
+
+    void ProgramCache::Insert(const Key& key, const shared_ptr<const CompiledProgram>& program)
+    {
+        size_t size = program->memory_size();
+
+        lock_guard<mutex> lock(this->mutex_);
+        //按名字排序，同名的键连续排列
+        bool is_exist = false;
+        auto it = this->index_.lower_bound(Key{ key.program_name, 0, false });
+        while (it != this->index_.end() && it->first.program_name == key.program_name) {
+            auto next = std::next(it);
+            if (it->first.source_hash != key.source_hash) {
+                this->EraseEntry(it->second);
+            }
+            else if (it->first.is_optimize == key.is_optimize) {
+                //其他线程已经编译了相同的程序
+                this->entries_.splice(this->entries_.begin(), this->entries_, it->second);
+                is_exist = true;
+            }
+            it = next;
+        }
+        if (is_exist || size > this->capacity_) {
+            return;
+        }
+        this->entries_.push_front(Entry{ key, program, size });
+        this->index_.emplace(key, this->entries_.begin());
+        this->size_ += size;
+        this->Trim();
+    }
+
+    void ProgramCache::Invalidate(wstring_view program_name)
+    {
+        lock_guard<mutex> lock(this->mutex_);
+        auto it = this->index_.lower_bound(Key{ wstring(program_name), 0, false });
+        while (it != this->index_.end() && it->first.program_name == program_name) {
+            auto next = std::next(it);
+            this->EraseEntry(it->second);
+            it = next;
+        }
+    }
+
+    void ProgramCache::Clear()
+    {
+        lock_guard<mutex> lock(this->mutex_);
+        this->index_.clear();
+        this->entries_.clear();
+        this->size_ = 0;
+    }
+
+    void ProgramCache::SetCapacity(size_t capacity)
+    {
+        lock_guard<mutex> lock(this->mutex_);
+        this->capacity_ = capacity;
+        this->Trim();
+    }
+
+    size_t ProgramCache::size() const
+    {
+        lock_guard<mutex> lock(this->mutex_);
+        return this->size_;
+    }
+
+    void ProgramCache::EraseEntry(list<Entry>::iterator it)
+    {
+        this->size_ -= it->size;
+        this->index_.erase(it->key);
+        this->entries_.erase(it);
+    }
+
+    void ProgramCache::Trim()
+    {
+        while (this->size_ > this->capacity_ && !this->entries_.empty()) {
+            this->EraseEntry(std::prev(this->entries_.end()));
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+#include "Token.h"
+#include "OpCommand.h"
+#include "Bytecode.h"
+#include "SymbolTable.h"
+
+namespace jxcode::atomscript
+{
+    //在只属于自己的符号表下编译的程序，创建后只读，可被多个解释器同时使用
+    class CompiledProgram
+    {
+    public:
+        std::shared_ptr<lexer::TokenList> tokens;
+        std::shared_ptr<CommandList> commands;
+        LabelMap labels;
+        Program program;
+        std::vector<std::wstring> symbols; //按槽位保存的变量名
+    public:
+        //估算占用的内存
+        size_t memory_size() const;
+        //复制指令，变量名在symbols中分配槽位，复制出的程序引用本对象的Token
+        Program Link(SymbolTable* symbols) const;
+    };
+
+    //按程序名与源码散列查找编译结果，线程安全
+    //超过容量时淘汰最久未使用的程序，被淘汰的程序在仍被解释器引用时继续存活
+    class ProgramCache
+    {
+    public:
+        struct Key
+        {
+            std::wstring program_name;
+            uint64_t source_hash;
+            bool is_optimize;
+
+            bool operator<(const Key& other) const;
+        };
+        static constexpr size_t kDefaultCapacity = 64 * 1024 * 1024;
+    protected:
+        struct Entry
+        {
+            Key key;
+            std::shared_ptr<const CompiledProgram> program;
+            size_t size;
+        };
+    protected:
+        mutable std::mutex mutex_;
+        std::list<Entry> entries_; //最近使用的在前
+        std::map<Key, std::list<Entry>::iterator> index_;
+        size_t capacity_;
+        size_t size_;
+    public:
+        explicit ProgramCache(size_t capacity = kDefaultCapacity);
+        ProgramCache(const ProgramCache&) = delete;
+        ProgramCache& operator=(const ProgramCache&) = delete;
+    public:
+        //不存在时返回空
+        std::shared_ptr<const CompiledProgram> Find(const Key& key);
+        //同名但源码不同的旧程序一并移除，超过容量的程序不保存
+        void Insert(const Key& key, const std::shared_ptr<const CompiledProgram>& program);
+        //移除该程序的所有版本
+        void Invalidate(std::wstring_view program_name);
+        void Clear();
+        void SetCapacity(size_t capacity);
+        size_t size() const;
+    protected:
+        void EraseEntry(std::list<Entry>::iterator it);
+        void Trim();
+    };
+}
@@ -0,0 +1,806 @@
+#include "ProgramImage.h"
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <codecvt>
+#include <locale>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace jxcode::atomscript
+{
+    using namespace std;
+    using namespace lexer;
+
+#pragma region ProgramImageException
+    ProgramImageException::ProgramImageException(const wstring& path, const wstring& message)
+        : path_(path), wexceptionbase(message) { }
+
+    wstring ProgramImageException::what()
+    {
+        return L"ProgramImageException: " + this->message_ + L".  " + this->path_;
+    }
+#pragma endregion
+
+    //文件格式：ImageHeader之后依次为以下各段，各段长度由头部的数量决定
+    //  ImageString[string_count]      字符串在字符区中的位置，前program_string_count项为Program::strings
+    //  int32_t[symbol_count]          变量名的字符串下标，下标即文件内的槽位
+    //  ImageToken[token_count]
+    //  ImageLine[line_count]          行表，从first_token开始的Token都在line行，直到下一项
+    //  ImageLabel[label_count]
+    //  ImageInstruction[instruction_count]
+    //  ImageCallSite[call_site_count]
+    //  uint32_t[token_ref_count]      命令操作数、调用点域与路径的Token下标
+    //  ImageOperand[operand_count]    调用点参数
+    //  wchar_t[char_count]            字符区，每个字符串以'\0'结尾
+    //所有下标为-1表示空
+    static constexpr uint32_t kImageMagic = 0x49505341; // "ASPI"
+
+    struct ImageHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t char_size;
+        uint32_t header_size;
+        uint64_t hash;         //头部之后所有内容的FNV-1a散列
+        uint64_t payload_size;
+        uint32_t program_string_count;
+        uint32_t string_count;
+        uint32_t char_count;
+        uint32_t symbol_count;
+        uint32_t token_count;
+        uint32_t line_count;
+        uint32_t label_count;
+        uint32_t instruction_count;
+        uint32_t call_site_count;
+        uint32_t token_ref_count;
+        uint32_t operand_count;
+        uint32_t reserved;
+    };
+
+    struct ImageString
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct ImageToken
+    {
+        uint32_t type;
+        int32_t value;
+        uint32_t position;
+    };
+
+    struct ImageLine
+    {
+        uint32_t first_token;
+        uint32_t line;
+    };
+
+    struct ImageLabel
+    {
+        int32_t name;
+        uint32_t index;
+    };
+
+    struct ImageOperand
+    {
+        uint32_t kind;
+        uint32_t value; //数字的位、字符串下标或文件内的槽位
+        int32_t token;
+    };
+
+    struct ImageInstruction
+    {
+        uint8_t code;
+        uint8_t compare;
+        uint8_t op_code;
+        uint8_t reserved;
+        int32_t jump;
+        int32_t op_token;
+        int32_t error;
+        uint32_t targets;       //命令操作数在token_refs中的位置
+        uint32_t targets_count;
+        ImageOperand x;
+        ImageOperand y;
+    };
+
+    struct ImageCallShape
+    {
+        uint32_t target;
+        int32_t function;
+        uint32_t domain;
+        uint32_t domain_count;
+        uint32_t path;
+        uint32_t path_count;
+        uint32_t args;
+        uint32_t args_count;
+        int32_t error;
+    };
+
+    struct ImageCallSite
+    {
+        int32_t id;
+        int32_t object_slot;
+        int32_t object_token;
+        ImageCallShape static_call;
+        ImageCallShape instance_call;
+    };
+
+    //映射后各段的位置
+    struct ImageView
+    {
+        const ImageHeader* header;
+        const ImageString* strings;
+        const int32_t* symbols;
+        const ImageToken* tokens;
+        const ImageLine* lines;
+        const ImageLabel* labels;
+        const ImageInstruction* instructions;
+        const ImageCallSite* call_sites;
+        const uint32_t* token_refs;
+        const ImageOperand* operands;
+        const wchar_t* chars;
+    };
+
+    template<typename T>
+    inline static const T* TakeSection(const uint8_t** cursor, uint32_t count)
+    {
+        const T* section = reinterpret_cast<const T*>(*cursor);
+        *cursor += sizeof(T) * (size_t)count;
+        return section;
+    }
+
+    static ImageView MakeView(const uint8_t* data)
+    {
+        ImageView view;
+        view.header = reinterpret_cast<const ImageHeader*>(data);
+        const ImageHeader& h = *view.header;
+        const uint8_t* cursor = data + h.header_size;
+        view.strings = TakeSection<ImageString>(&cursor, h.string_count);
+        view.symbols = TakeSection<int32_t>(&cursor, h.symbol_count);
+        view.tokens = TakeSection<ImageToken>(&cursor, h.token_count);
+        view.lines = TakeSection<ImageLine>(&cursor, h.line_count);
+        view.labels = TakeSection<ImageLabel>(&cursor, h.label_count);
+        view.instructions = TakeSection<ImageInstruction>(&cursor, h.instruction_count);
+        view.call_sites = TakeSection<ImageCallSite>(&cursor, h.call_site_count);
+        view.token_refs = TakeSection<uint32_t>(&cursor, h.token_ref_count);
+        view.operands = TakeSection<ImageOperand>(&cursor, h.operand_count);
+        view.chars = TakeSection<wchar_t>(&cursor, h.char_count);
+        return view;
+    }
+
+    uint64_t HashBytes(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+#ifdef _WIN32
+    inline static const wstring& NativePath(const wstring& path)
+    {
+        return path;
+    }
+#else
+    inline static string NativePath(const wstring& path)
+    {
+        wstring_convert<codecvt_utf8<wchar_t>> c;
+        return c.to_bytes(path);
+    }
+#endif
+
+#pragma region Write
+    class ImageWriter
+    {
+    protected:
+        unordered_map<wstring_view, int32_t> string_index_;
+        unordered_map<const Token*, int32_t> token_index_;
+    public:
+        vector<ImageString> strings;
+        wstring chars;
+        vector<int32_t> symbols;
+        vector<ImageToken> tokens;
+        vector<ImageLine> lines;
+        vector<ImageLabel> labels;
+        vector<ImageInstruction> instructions;
+        vector<ImageCallSite> call_sites;
+        vector<uint32_t> token_refs;
+        vector<ImageOperand> operands;
+    public:
+        explicit ImageWriter(const Program* program)
+        {
+            //Program::strings的下标在文件中保持不变
+            for (wstring_view str : program->strings) {
+                this->PushString(str);
+            }
+        }
+    protected:
+        int32_t PushString(wstring_view str)
+        {
+            int32_t index = (int32_t)this->strings.size();
+            this->string_index_.emplace(str, index);
+            this->strings.push_back(ImageString{ (uint32_t)this->chars.size(), (uint32_t)str.size() });
+            this->chars.append(str);
+            this->chars.push_back(L'\0');
+            return index;
+        }
+    public:
+        int32_t AddString(wstring_view str)
+        {
+            auto it = this->string_index_.find(str);
+            if (it != this->string_index_.end()) {
+                return it->second;
+            }
+            return this->PushString(str);
+        }
+        int32_t AddToken(const Token* token)
+        {
+            if (token == nullptr) {
+                return -1;
+            }
+            auto it = this->token_index_.find(token);
+            if (it != this->token_index_.end()) {
+                return it->second;
+            }
+            int32_t index = (int32_t)this->tokens.size();
+            this->token_index_.emplace(token, index);
+            this->tokens.push_back(ImageToken{
+                (uint32_t)token->token_type, this->AddString(token->value), (uint32_t)token->position });
+            if (this->lines.empty() || this->lines.back().line != (uint32_t)token->line) {
+                this->lines.push_back(ImageLine{ (uint32_t)index, (uint32_t)token->line });
+            }
+            return index;
+        }
+        ImageOperand AddOperand(const Operand& op)
+        {
+            ImageOperand result{ (uint32_t)op.kind, 0, this->AddToken(op.token) };
+            switch (op.kind)
+            {
+            case OperandKind::Number:
+                memcpy(&result.value, &op.num, sizeof(float));
+                break;
+            case OperandKind::String:
+                result.value = (uint32_t)op.str;
+                break;
+            case OperandKind::Ident:
+                result.value = (uint32_t)op.slot;
+                break;
+            default:
+                break;
+            }
+            return result;
+        }
+        ImageCallShape AddCallShape(const CallShape& shape)
+        {
+            ImageCallShape result;
+            result.target = (uint32_t)shape.target;
+            result.function = this->AddString(shape.function);
+            result.domain = (uint32_t)this->token_refs.size();
+            result.domain_count = (uint32_t)shape.domain.size();
+            for (const Token& token : shape.domain) {
+                this->token_refs.push_back((uint32_t)this->AddToken(&token));
+            }
+            result.path = (uint32_t)this->token_refs.size();
+            result.path_count = (uint32_t)shape.path.size();
+            for (const Token& token : shape.path) {
+                this->token_refs.push_back((uint32_t)this->AddToken(&token));
+            }
+            result.args = (uint32_t)this->operands.size();
+            result.args_count = (uint32_t)shape.args.size();
+            for (const Operand& arg : shape.args) {
+                this->operands.push_back(this->AddOperand(arg));
+            }
+            result.error = this->AddToken(shape.error);
+            return result;
+        }
+        void AddInstruction(const Instruction& ins)
+        {
+            ImageInstruction result;
+            result.code = (uint8_t)ins.code;
+            result.compare = (uint8_t)ins.compare;
+            result.op_code = ins.cmd != nullptr ? (uint8_t)ins.cmd->code : 0;
+            result.reserved = 0;
+            result.jump = ins.jump;
+            result.op_token = ins.cmd != nullptr ? this->AddToken(&ins.cmd->op_token) : -1;
+            result.error = ins.error != nullptr ? this->AddString(ins.error) : -1;
+            result.targets = (uint32_t)this->token_refs.size();
+            result.targets_count = ins.cmd != nullptr ? (uint32_t)ins.cmd->targets.size() : 0;
+            for (uint32_t i = 0; i < result.targets_count; i++) {
+                this->token_refs.push_back((uint32_t)this->AddToken(&ins.cmd->targets[i]));
+            }
+            result.x = this->AddOperand(ins.x);
+            result.y = this->AddOperand(ins.y);
+            this->instructions.push_back(result);
+        }
+        ImageCallSite MakeCallSite(const CallSite& site)
+        {
+            ImageCallSite result;
+            result.id = site.id;
+            result.object_slot = site.object_slot;
+            result.object_token = this->AddToken(site.object_token);
+            result.static_call = this->AddCallShape(site.static_call);
+            result.instance_call = this->AddCallShape(site.instance_call);
+            return result;
+        }
+    };
+
+    template<typename T>
+    inline static void AppendSection(string* out, const vector<T>& section)
+    {
+        out->append(reinterpret_cast<const char*>(section.data()), sizeof(T) * section.size());
+    }
+
+    void ProgramImage::Write(const wstring& path, const Program& program, const SymbolTable& symbols, const LabelMap& labels)
+    {
+        ImageWriter writer(&program);
+
+        writer.symbols.resize(symbols.size(), -1);
+        for (auto& item : symbols.index()) {
+            writer.symbols[item.second] = writer.AddString(item.first);
+        }
+        for (auto& item : labels) {
+            writer.labels.push_back(ImageLabel{ writer.AddString(item.first), (uint32_t)item.second });
+        }
+        //Token按指令顺序加入，同一行的Token连续，行表较短
+        writer.call_sites.resize(program.call_sites.size());
+        vector<bool> is_added(program.call_sites.size(), false);
+        for (const Instruction& ins : program.code) {
+            writer.AddInstruction(ins);
+            if (ins.code == InstrCode::Call && !is_added[ins.jump]) {
+                writer.call_sites[ins.jump] = writer.MakeCallSite(program.call_sites[ins.jump]);
+                is_added[ins.jump] = true;
+            }
+        }
+        //优化删除了调用指令的调用点
+        for (size_t i = 0; i < program.call_sites.size(); i++) {
+            if (!is_added[i]) {
+                writer.call_sites[i] = writer.MakeCallSite(program.call_sites[i]);
+            }
+        }
+
+        ImageHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = kImageMagic;
+        header.version = kVersion;
+        header.char_size = sizeof(wchar_t);
+        header.header_size = sizeof(ImageHeader);
+        header.program_string_count = (uint32_t)program.strings.size();
+        header.string_count = (uint32_t)writer.strings.size();
+        header.char_count = (uint32_t)writer.chars.size();
+        header.symbol_count = (uint32_t)writer.symbols.size();
+        header.token_count = (uint32_t)writer.tokens.size();
+        header.line_count = (uint32_t)writer.lines.size();
+        header.label_count = (uint32_t)writer.labels.size();
+        header.instruction_count = (uint32_t)writer.instructions.size();
+        header.call_site_count = (uint32_t)writer.call_sites.size();
+        header.token_ref_count = (uint32_t)writer.token_refs.size();
+        header.operand_count = (uint32_t)writer.operands.size();
+
+        string payload;
+        AppendSection(&payload, writer.strings);
+        AppendSection(&payload, writer.symbols);
+        AppendSection(&payload, writer.tokens);
+        AppendSection(&payload, writer.lines);
+        AppendSection(&payload, writer.labels);
+        AppendSection(&payload, writer.instructions);
+        AppendSection(&payload, writer.call_sites);
+        AppendSection(&payload, writer.token_refs);
+        AppendSection(&payload, writer.operands);
+        payload.append(reinterpret_cast<const char*>(writer.chars.data()), sizeof(wchar_t) * writer.chars.size());
+
+        header.payload_size = payload.size();
+        header.hash = HashBytes(payload.data(), payload.size());
+
+        ofstream file(NativePath(path), ios::binary | ios::trunc);
+        if (!file) {
+            throw ProgramImageException(path, L"can not open file");
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(payload.data(), payload.size());
+        if (!file) {
+            throw ProgramImageException(path, L"write error");
+        }
+    }
+#pragma endregion
+
+#pragma region Load
+    struct ProgramImage::MappedFile
+    {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if (this->data != nullptr) {
+                UnmapViewOfFile(this->data);
+            }
+            if (this->mapping != nullptr) {
+                CloseHandle(this->mapping);
+            }
+            if (this->file != INVALID_HANDLE_VALUE) {
+                CloseHandle(this->file);
+            }
+#else
+            if (this->data != nullptr) {
+                munmap(const_cast<uint8_t*>(this->data), this->size);
+            }
+#endif
+        }
+
+        //只读映射，文件太小时不映射
+        bool Open(const wstring& path)
+        {
+#ifdef _WIN32
+            this->file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (this->file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(this->file, &file_size) || file_size.QuadPart < (LONGLONG)sizeof(ImageHeader)) {
+                return false;
+            }
+            this->mapping = CreateFileMappingW(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (this->mapping == nullptr) {
+                return false;
+            }
+            this->data = static_cast<const uint8_t*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+            this->size = (size_t)file_size.QuadPart;
+            return this->data != nullptr;
+#else
+            int fd = open(NativePath(path).c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ImageHeader)) {
+                close(fd);
+                return false;
+            }
+            void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (ptr == MAP_FAILED) {
+                return false;
+            }
+            this->data = static_cast<const uint8_t*>(ptr);
+            this->size = (size_t)st.st_size;
+            return true;
+#endif
+        }
+    };
+
+    //检查文件内的下标，校验通过后Link不再检查
+    class ImageValidator
+    {
+    protected:
+        const ImageView* view_;
+        const wstring* path_;
+    public:
+        ImageValidator(const ImageView* view, const wstring* path) : view_(view), path_(path) { }
+    protected:
+        void Check(bool condition) const
+        {
+            if (!condition) {
+                throw ProgramImageException(*this->path_, L"corrupted image");
+            }
+        }
+        void CheckIndex(int32_t index, uint32_t count, bool nullable) const
+        {
+            this->Check((nullable && index == -1) || (index >= 0 && (uint32_t)index < count));
+        }
+        void CheckOperand(const ImageOperand& op) const
+        {
+            const ImageHeader& h = *this->view_->header;
+            this->Check(op.kind <= (uint32_t)OperandKind::Ident);
+            this->CheckIndex(op.token, h.token_count, op.kind == (uint32_t)OperandKind::None);
+            if (op.kind == (uint32_t)OperandKind::String) {
+                this->Check(op.value < h.program_string_count);
+            }
+            else if (op.kind == (uint32_t)OperandKind::Ident) {
+                this->Check(op.value < h.symbol_count);
+            }
+        }
+        void CheckCallShape(const ImageCallShape& shape) const
+        {
+            const ImageHeader& h = *this->view_->header;
+            this->Check(shape.target <= (uint32_t)CallTarget::Strlib);
+            this->CheckIndex(shape.function, h.string_count, false);
+            this->Check(shape.domain <= h.token_ref_count && shape.domain_count <= h.token_ref_count - shape.domain);
+            this->Check(shape.path <= h.token_ref_count && shape.path_count <= h.token_ref_count - shape.path);
+            this->Check(shape.args <= h.operand_count && shape.args_count <= h.operand_count - shape.args);
+            for (uint32_t i = 0; i < shape.args_count; i++) {
+                this->CheckOperand(this->view_->operands[shape.args + i]);
+            }
+            this->CheckIndex(shape.error, h.token_count, true);
+        }
+    public:
+        void Validate() const
+        {
+            const ImageView& v = *this->view_;
+            const ImageHeader& h = *v.header;
+
+            this->Check(h.program_string_count <= h.string_count);
+            for (uint32_t i = 0; i < h.string_count; i++) {
+                const ImageString& str = v.strings[i];
+                this->Check(str.offset < h.char_count && str.length < h.char_count - str.offset);
+                this->Check(v.chars[str.offset + str.length] == L'\0');
+            }
+            for (uint32_t i = 0; i < h.symbol_count; i++) {
+                this->CheckIndex(v.symbols[i], h.string_count, false);
+            }
+            for (uint32_t i = 0; i < h.token_count; i++) {
+                this->CheckIndex(v.tokens[i].value, h.string_count, false);
+            }
+            this->Check(h.token_count == 0 || (h.line_count > 0 && v.lines[0].first_token == 0));
+            for (uint32_t i = 0; i < h.token_ref_count; i++) {
+                this->Check(v.token_refs[i] < h.token_count);
+            }
+            for (uint32_t i = 0; i < h.label_count; i++) {
+                this->CheckIndex(v.labels[i].name, h.string_count, false);
+                this->Check(v.labels[i].index < h.instruction_count);
+            }
+
+            //末尾两条End之前的指令都有源命令
+            this->Check(h.instruction_count >= 2);
+            uint64_t targets_count = 0;
+            for (uint32_t i = 0; i < h.instruction_count; i++) {
+                const ImageInstruction& ins = v.instructions[i];
+                bool is_end = i >= h.instruction_count - 2;
+                this->Check(ins.code <= (uint8_t)InstrCode::End && (ins.code == (uint8_t)InstrCode::End) == is_end);
+                this->Check(ins.code != (uint8_t)InstrCode::EnterBlock);
+                this->Check(ins.op_code <= (uint8_t)OpCode::ToProg);
+                this->CheckIndex(ins.op_token, h.token_count, is_end);
+                this->CheckIndex(ins.error, h.string_count, ins.code != (uint8_t)InstrCode::Error);
+                this->CheckOperand(ins.x);
+                this->CheckOperand(ins.y);
+                this->Check(ins.targets <= h.token_ref_count && ins.targets_count <= h.token_ref_count - ins.targets);
+                this->Check(!is_end || ins.targets_count == 0);
+                targets_count += ins.targets_count;
+                //执行时直接按槽位访问变量的操作数
+                switch ((InstrCode)ins.code)
+                {
+                case InstrCode::Set:
+                    this->Check(ins.x.kind == (uint32_t)OperandKind::Ident && ins.y.kind != (uint32_t)OperandKind::None);
+                    break;
+                case InstrCode::Del:
+                case InstrCode::GotoVar:
+                    this->Check(ins.x.kind == (uint32_t)OperandKind::Ident);
+                    break;
+                case InstrCode::IfGotoNum:
+                    this->Check(ins.x.kind == (uint32_t)OperandKind::Ident && ins.y.kind == (uint32_t)OperandKind::Number);
+                    break;
+                case InstrCode::IfGotoStr:
+                    this->Check(ins.x.kind == (uint32_t)OperandKind::Ident && ins.y.kind == (uint32_t)OperandKind::String);
+                    break;
+                default:
+                    break;
+                }
+                switch ((InstrCode)ins.code)
+                {
+                case InstrCode::Goto:
+                case InstrCode::IfGoto:
+                case InstrCode::IfGotoNum:
+                case InstrCode::IfGotoStr:
+                case InstrCode::IfGotoNumNum:
+                case InstrCode::IfGotoStrPtrEq:
+                    this->CheckIndex(ins.jump, h.instruction_count, false);
+                    break;
+                case InstrCode::Call:
+                    this->CheckIndex(ins.jump, h.call_site_count, false);
+                    break;
+                //标签在执行时查找，跳转位置为执行时的缓存
+                case InstrCode::GotoVar:
+                    this->Check(ins.jump == -1);
+                    break;
+                case InstrCode::IfGotoVar:
+                    this->Check(ins.jump == -1 && v.instructions[i + 1].code == (uint8_t)InstrCode::GotoVar);
+                    break;
+                case InstrCode::Error:
+                case InstrCode::ClearSub:
+                    this->Check(ins.x.token >= 0);
+                    break;
+                default:
+                    break;
+                }
+            }
+            for (uint32_t i = 0; i < h.call_site_count; i++) {
+                const ImageCallSite& site = v.call_sites[i];
+                this->Check(site.id == (int32_t)i);
+                this->CheckIndex(site.object_slot, h.symbol_count, false);
+                this->CheckIndex(site.object_token, h.token_count, false);
+                this->CheckCallShape(site.static_call);
+                this->CheckCallShape(site.instance_call);
+            }
+            this->Check(targets_count <= h.token_ref_count);
+        }
+    };
+
+    inline static wstring_view ImageStringView(const ImageView& view, int32_t index)
+    {
+        const ImageString& str = view.strings[index];
+        return wstring_view(view.chars + str.offset, str.length);
+    }
+
+    ProgramImage::ProgramImage(const wstring& path)
+        : file_(new MappedFile())
+    {
+        if (!this->file_->Open(path)) {
+            throw ProgramImageException(path, L"can not open file");
+        }
+        const ImageHeader& h = *reinterpret_cast<const ImageHeader*>(this->file_->data);
+        if (h.magic != kImageMagic || h.header_size != sizeof(ImageHeader)) {
+            throw ProgramImageException(path, L"not a program image");
+        }
+        if (h.version != kVersion || h.char_size != sizeof(wchar_t)) {
+            throw ProgramImageException(path, L"unsupported image version");
+        }
+        if (h.payload_size != this->file_->size - sizeof(ImageHeader)) {
+            throw ProgramImageException(path, L"corrupted image");
+        }
+        //各段长度之和与文件一致后再计算位置
+        uint64_t sections_size =
+            sizeof(ImageString) * (uint64_t)h.string_count +
+            sizeof(int32_t) * (uint64_t)h.symbol_count +
+            sizeof(ImageToken) * (uint64_t)h.token_count +
+            sizeof(ImageLine) * (uint64_t)h.line_count +
+            sizeof(ImageLabel) * (uint64_t)h.label_count +
+            sizeof(ImageInstruction) * (uint64_t)h.instruction_count +
+            sizeof(ImageCallSite) * (uint64_t)h.call_site_count +
+            sizeof(uint32_t) * (uint64_t)h.token_ref_count +
+            sizeof(ImageOperand) * (uint64_t)h.operand_count +
+            sizeof(wchar_t) * (uint64_t)h.char_count;
+        if (sections_size != h.payload_size) {
+            throw ProgramImageException(path, L"corrupted image");
+        }
+        if (HashBytes(this->file_->data + sizeof(ImageHeader), (size_t)h.payload_size) != h.hash) {
+            throw ProgramImageException(path, L"hash mismatch");
+        }
+
+        ImageView view = MakeView(this->file_->data);
+        ImageValidator(&view, &path).Validate();
+
+        //Token的值直接引用映射中的字符
+        this->tokens_.resize(h.token_count);
+        uint32_t line_index = 0;
+        for (uint32_t i = 0; i < h.token_count; i++) {
+            while (line_index + 1 < h.line_count && view.lines[line_index + 1].first_token <= i) {
+                line_index++;
+            }
+            const ImageToken& token = view.tokens[i];
+            Token& item = this->tokens_[i];
+            item.token_type = (TokenType)token.type;
+            item.value = ImageStringView(view, token.value);
+            item.line = view.lines[line_index].line;
+            item.position = token.position;
+        }
+
+        //先复制全部操作数，targets_不再扩容后再生成命令
+        this->commands_.resize(h.instruction_count - 2);
+        for (size_t i = 0; i < this->commands_.size(); i++) {
+            const ImageInstruction& ins = view.instructions[i];
+            for (uint32_t j = 0; j < ins.targets_count; j++) {
+                this->targets_.push_back(this->tokens_[view.token_refs[ins.targets + j]]);
+            }
+        }
+        size_t target_index = 0;
+        for (size_t i = 0; i < this->commands_.size(); i++) {
+            const ImageInstruction& ins = view.instructions[i];
+            TokenSpan targets(this->targets_.data() + target_index, ins.targets_count);
+            target_index += ins.targets_count;
+            this->commands_[i] = OpCommand((OpCode)ins.op_code, this->tokens_[ins.op_token], targets);
+        }
+
+        for (uint32_t i = 0; i < h.label_count; i++) {
+            this->labels_.emplace(ImageStringView(view, view.labels[i].name), view.labels[i].index);
+        }
+    }
+
+    ProgramImage::~ProgramImage()
+    {
+    }
+
+    inline static Operand LinkOperand(const ImageOperand& op, const vector<Token>& tokens, const vector<int32_t>& slots)
+    {
+        Operand result;
+        result.kind = (OperandKind)op.kind;
+        result.str = 0;
+        result.token = op.token >= 0 ? &tokens[op.token] : nullptr;
+        switch (result.kind)
+        {
+        case OperandKind::Number:
+            memcpy(&result.num, &op.value, sizeof(float));
+            break;
+        case OperandKind::String:
+            result.str = (int32_t)op.value;
+            break;
+        case OperandKind::Ident:
+            result.slot = slots[op.value];
+            break;
+        default:
+            break;
+        }
+        return result;
+    }
+
+    Program ProgramImage::Link(SymbolTable* symbols) const
+    {
+        ImageView view = MakeView(this->file_->data);
+        const ImageHeader& h = *view.header;
+
+        //文件内的槽位换成symbols中的槽位
+        vector<int32_t> slots(h.symbol_count);
+        for (uint32_t i = 0; i < h.symbol_count; i++) {
+            slots[i] = symbols->Intern(ImageStringView(view, view.symbols[i]));
+        }
+
+        Program program;
+        program.strings.reserve(h.program_string_count);
+        for (uint32_t i = 0; i < h.program_string_count; i++) {
+            program.strings.push_back(ImageStringView(view, (int32_t)i));
+        }
+
+        program.code.resize(h.instruction_count);
+        for (uint32_t i = 0; i < h.instruction_count; i++) {
+            const ImageInstruction& src = view.instructions[i];
+            Instruction& ins = program.code[i];
+            ins.code = (InstrCode)src.code;
+            ins.compare = (TokenType)src.compare;
+            ins.jump = src.jump;
+            ins.x = LinkOperand(src.x, this->tokens_, slots);
+            ins.y = LinkOperand(src.y, this->tokens_, slots);
+            ins.cmd = i < this->commands_.size() ? &this->commands_[i] : nullptr;
+            ins.error = src.error >= 0 ? ImageStringView(view, src.error).data() : nullptr;
+            ins.is_unstable = false;
+            ins.label_ptr = 0;
+        }
+
+        auto link_shape = [&](const ImageCallShape& src, CallShape* shape) {
+            shape->target = (CallTarget)src.target;
+            shape->function = ImageStringView(view, src.function);
+            for (uint32_t i = 0; i < src.domain_count; i++) {
+                shape->domain.push_back(this->tokens_[view.token_refs[src.domain + i]]);
+            }
+            for (uint32_t i = 0; i < src.path_count; i++) {
+                shape->path.push_back(this->tokens_[view.token_refs[src.path + i]]);
+            }
+            for (uint32_t i = 0; i < src.args_count; i++) {
+                shape->args.push_back(LinkOperand(view.operands[src.args + i], this->tokens_, slots));
+            }
+            shape->error = src.error >= 0 ? &this->tokens_[src.error] : nullptr;
+        };
+        program.call_sites.resize(h.call_site_count);
+        for (uint32_t i = 0; i < h.call_site_count; i++) {
+            const ImageCallSite& src = view.call_sites[i];
+            CallSite& site = program.call_sites[i];
+            site.id = src.id;
+            site.object_slot = slots[src.object_slot];
+            site.object_token = &this->tokens_[src.object_token];
+            link_shape(src.static_call, &site.static_call);
+            link_shape(src.instance_call, &site.instance_call);
+        }
+        return program;
+    }
+#pragma endregion
+}
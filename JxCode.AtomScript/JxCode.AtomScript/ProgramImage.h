@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include "Token.h"
+#include "OpCommand.h"
+#include "Bytecode.h"
+#include "SymbolTable.h"
+#include "wexceptionbase.h"
+
+namespace jxcode::atomscript
+{
+    //FNV-1a 64位散列，预编译文件与程序缓存共用
+    uint64_t HashBytes(const void* data, size_t size);
+
+    class ProgramImageException : public wexceptionbase
+    {
+    protected:
+        std::wstring path_;
+    public:
+        ProgramImageException(const std::wstring& path, const std::wstring& message);
+    public:
+        virtual std::wstring what() override;
+    };
+
+    //预编译程序文件，内容为编译后的指令、字符串表、变量名、标签与Token，
+    //Token的行号以连续相同行合并的行表保存。
+    //按本机字节序与wchar_t宽度写入，头部记录版本与内容的FNV-1a散列，不符时拒绝加载
+    //只保存编译前的通用指令，快速指令在执行时重新改写
+    class ProgramImage
+    {
+    public:
+        static constexpr uint32_t kVersion = 2;
+    protected:
+        struct MappedFile;
+        std::unique_ptr<MappedFile> file_;
+        //以下均引用映射中的字符串，映射与本对象同时释放
+        std::vector<lexer::Token> tokens_;
+        //命令的操作数按命令顺序连续保存，OpCommand::targets引用其中一段
+        std::vector<lexer::Token> targets_;
+        std::vector<OpCommand> commands_;
+        LabelMap labels_;
+    public:
+        //program的槽位需要全部来自symbols，通常使用只属于这次编译的符号表
+        static void Write(
+            const std::wstring& path,
+            const Program& program,
+            const SymbolTable& symbols,
+            const LabelMap& labels);
+    public:
+        //映射文件并校验，失败时抛出ProgramImageException
+        explicit ProgramImage(const std::wstring& path);
+        ProgramImage(const ProgramImage&) = delete;
+        ProgramImage& operator=(const ProgramImage&) = delete;
+        ~ProgramImage();
+    public:
+        const LabelMap& labels() const { return this->labels_; }
+        //生成指令，变量名在symbols中分配槽位，程序引用本对象的Token，需要本对象存活
+        Program Link(SymbolTable* symbols) const;
+    };
+}
@@ -0,0 +1,107 @@
+#include "StreamParser.h"
+#include <algorithm>
+#include "CharScan.h"
+
+namespace jxcode::atomscript
+{
+    using namespace std;
+    using namespace lexer;
+
+    template<typename CharT>
+    BasicStreamParser<CharT>::BasicStreamParser(
+        BasicLexer<CharT>* lexer,
+        const ReadCallBack& read,
+        TokenList* tokens,
+        wstring* program_name,
+        size_t chunk_size)
+        : lexer_(lexer), read_(read), interner_(tokens), program_name_(program_name),
+        chunk_size_((std::max)(chunk_size, (size_t)1)), scan_size_(chunk_size_),
+        read_offset_(0), line_offset_(0), is_eof_(false), is_finished_(false)
+    {
+    }
+
+    template<typename CharT>
+    void BasicStreamParser<CharT>::Read()
+    {
+        size_t size = this->carry_.size();
+        this->carry_.resize(size + this->chunk_size_);
+        size_t count = this->read_(this->read_offset_, &this->carry_[size], this->chunk_size_);
+        count = (std::min)(count, this->chunk_size_);
+        this->carry_.resize(size + count);
+        this->read_offset_ += count;
+        if (count == 0) {
+            this->is_eof_ = true;
+        }
+    }
+
+    template<typename CharT>
+    void BasicStreamParser<CharT>::Defer()
+    {
+        //每次至少等到长度翻倍，跨越多行的字符串或注释总共只重复分析常数次
+        size_t size = this->carry_.size();
+        this->scan_size_ = (std::max)(size + this->chunk_size_, size * 2);
+    }
+
+    template<typename CharT>
+    bool BasicStreamParser<CharT>::ParseNext(CommandList* commands)
+    {
+        if (this->is_finished_) {
+            return false;
+        }
+
+        shared_ptr<const basic_string<CharT>> chunk;
+        BasicTokenList<CharT> chunk_tokens;
+        bool is_end = false;
+        while (true) {
+            if (!this->is_eof_) {
+                this->Read();
+                if (!this->is_eof_ && this->carry_.size() < this->scan_size_) {
+                    continue;
+                }
+            }
+            size_t cut = this->carry_.size();
+            if (!this->is_eof_) {
+                size_t lf = this->carry_.rfind((CharT)'\n');
+                if (lf == basic_string<CharT>::npos) {
+                    this->Defer();
+                    continue;
+                }
+                cut = lf + 1;
+            }
+            chunk = make_shared<const basic_string<CharT>>(this->carry_, 0, cut);
+
+            size_t consumed = 0;
+            chunk_tokens = this->lexer_->ScanChunk(chunk, this->is_eof_, this->line_offset_, &consumed, &is_end);
+            if (consumed == 0 && !is_end) {
+                //整块都在一个未闭合的字符串或注释中，继续读取
+                this->Defer();
+                continue;
+            }
+            this->line_offset_ += (int)charscan::CountChar(chunk->data(), chunk->data() + consumed, (CharT)'\n');
+            this->carry_.erase(0, consumed);
+            this->scan_size_ = this->carry_.size() + this->chunk_size_;
+            break;
+        }
+
+        //Token的值转移到驻留存储中，之后源码块可以释放
+        TokenList tokens;
+        tokens.tokens.reserve(chunk_tokens.tokens.size());
+        for (const auto& item : chunk_tokens.tokens) {
+            tokens.tokens.push_back(Token{ item.token_type, this->interner_.Intern(item.value), item.line, item.position });
+        }
+        chunk_tokens = BasicTokenList<CharT>();
+        chunk.reset();
+
+        this->parser_.Parse(this->program_name_, &tokens, commands);
+
+        if (is_end) {
+            this->is_finished_ = true;
+            this->carry_.clear();
+            this->carry_.shrink_to_fit();
+        }
+        return true;
+    }
+
+    template class BasicStreamParser<wchar_t>;
+    template class BasicStreamParser<char>;
+}
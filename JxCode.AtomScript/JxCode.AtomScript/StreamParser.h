@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "Token.h"
+#include "Lexer.h"
+#include "OpCommand.h"
+
+namespace jxcode::atomscript
+{
+    //分块读取源码，逐块词法分析并解析为命令
+    //每块只分析到最后一个换行，跨块的字符串与多行注释留到下一块继续
+    //命令中的Token引用tokens中驻留的字符串，源码块在解析后即释放，峰值内存只与块大小有关
+    template<typename CharT>
+    class BasicStreamParser
+    {
+    public:
+        static constexpr size_t kDefaultChunkSize = 64 * 1024;
+        //从offset处读取最多capacity个字符到buffer，返回读取的字符数，返回0表示结束
+        using ReadCallBack = std::function<size_t(size_t offset, CharT* buffer, size_t capacity)>;
+    protected:
+        lexer::BasicLexer<CharT>* lexer_;
+        ReadCallBack read_;
+        lexer::TokenInterner interner_;
+        CommandParser parser_;
+        std::wstring* program_name_;
+        size_t chunk_size_;
+
+        std::basic_string<CharT> carry_;
+        size_t scan_size_;  // carry_达到该长度后才重新分析，回调每次只返回少量字符时避免反复分析
+        size_t read_offset_;
+        int line_offset_;
+        bool is_eof_;
+        bool is_finished_;
+    public:
+        BasicStreamParser(
+            lexer::BasicLexer<CharT>* lexer,
+            const ReadCallBack& read,
+            lexer::TokenList* tokens,
+            std::wstring* program_name,
+            size_t chunk_size = kDefaultChunkSize);
+    public:
+        //解析下一块并把命令追加到commands，全部解析完成后返回false
+        bool ParseNext(CommandList* commands);
+    protected:
+        void Read();
+        //当前的carry_无法分析出完整的行，等到读取更多字符后再分析
+        void Defer();
+    };
+
+    using StreamParser = BasicStreamParser<wchar_t>;
+    using Utf8StreamParser = BasicStreamParser<char>;
+}
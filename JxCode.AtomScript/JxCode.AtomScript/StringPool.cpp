@@ -0,0 +1,429 @@
+#include "StringPool.h"
+#include <new>
+#include <cstring>
+#include <algorithm>
+
+namespace jxcode::atomscript
+{
+    using namespace std;
+
+    StringPool::StringPool()
+        : size_(0), last_id_(0), is_unique_(true), epoch_(0), is_sweeping_(false), sweep_cursor_(0),
+        live_bytes_(0), rope_bytes_(0), arena_bytes_(0), allocated_bytes_(0)
+    {
+    }
+
+    size_t StringPool::EntrySize(size_t length)
+    {
+        //下一个头部按头部对齐
+        size_t size = sizeof(Header) + length * sizeof(wchar_t);
+        return (size + alignof(Header) - 1) & ~(alignof(Header) - 1);
+    }
+
+    StringPool::Header* StringPool::Slot(int32_t id) const
+    {
+        size_t page = (size_t)(uint32_t)id >> kPageBits;
+        if (id <= 0 || page >= this->pages_.size() || !this->pages_[page]) {
+            return nullptr;
+        }
+        return this->pages_[page]->slots[id & (kPageSize - 1)];
+    }
+
+    void StringPool::SetSlot(int32_t id, Header* header)
+    {
+        size_t page = (size_t)id >> kPageBits;
+        if (page >= this->pages_.size()) {
+            this->pages_.resize(page + 1);
+        }
+        unique_ptr<Page>& p = this->pages_[page];
+        if (!p) {
+            p.reset(new Page());
+        }
+        Header*& slot = p->slots[id & (kPageSize - 1)];
+        if (slot == nullptr && header != nullptr) {
+            p->count++;
+        }
+        else if (slot != nullptr && header == nullptr) {
+            p->count--;
+        }
+        slot = header;
+        if (p->count == 0) {
+            p.reset();
+        }
+    }
+
+    StringPool::Header* StringPool::Allocate(size_t size)
+    {
+        if (this->slabs_.empty() || this->slabs_.back().capacity - this->slabs_.back().used < size) {
+            size_t capacity = (std::max)(kSlabSize, size);
+            this->slabs_.push_back(Slab{ unique_ptr<char[]>(new char[capacity]), capacity, 0 });
+        }
+        Slab& slab = this->slabs_.back();
+        char* ptr = slab.data.get() + slab.used;
+        slab.used += size;
+        this->arena_bytes_ += size;
+        return reinterpret_cast<Header*>(ptr);
+    }
+
+    StringPool::Header* StringPool::Insert(int32_t id, wstring_view str, uint32_t hash)
+    {
+        size_t size = EntrySize(str.size());
+        //str可能引用池中的字符串，分配新块不会移动已有的字符串
+        Header* header = new (this->Allocate(size)) Header;
+        header->length = (uint32_t)str.size();
+        header->hash = hash;
+        //新字符串视为已标记
+        header->mark = this->epoch_;
+        header->is_pinned = 0;
+        if (!str.empty()) {
+            memcpy(header + 1, str.data(), str.size() * sizeof(wchar_t));
+        }
+        this->SetSlot(id, header);
+        this->size_++;
+        this->live_bytes_ += size;
+        this->allocated_bytes_ += size;
+        return header;
+    }
+
+    size_t StringPool::FindBucket(wstring_view str, uint32_t hash) const
+    {
+        size_t mask = this->buckets_.size() - 1;
+        size_t i = hash & mask;
+        for (; this->buckets_[i] != 0; i = (i + 1) & mask) {
+            const Header* header = this->Slot(this->buckets_[i]);
+            if (header->hash == hash && header->view() == str) {
+                break;
+            }
+        }
+        return i;
+    }
+
+    void StringPool::ReserveBucket()
+    {
+        //负载不超过一半
+        if ((this->size_ + 1) * 2 > this->buckets_.size()) {
+            this->Rehash((std::max)((size_t)16, this->buckets_.size() * 2));
+        }
+    }
+
+    void StringPool::Rehash(size_t capacity)
+    {
+        vector<int32_t> old(capacity, 0);
+        old.swap(this->buckets_);
+        size_t mask = capacity - 1;
+        for (int32_t id : old) {
+            if (id == 0) {
+                continue;
+            }
+            size_t i = this->Slot(id)->hash & mask;
+            while (this->buckets_[i] != 0) {
+                i = (i + 1) & mask;
+            }
+            this->buckets_[i] = id;
+        }
+    }
+
+    void StringPool::EraseBucket(int32_t id, uint32_t hash)
+    {
+        size_t mask = this->buckets_.size() - 1;
+        size_t i = hash & mask;
+        for (; this->buckets_[i] != id; i = (i + 1) & mask) {
+            //内容重复时索引可能指向另一个id
+            if (this->buckets_[i] == 0) {
+                return;
+            }
+        }
+        //后面同一探测序列上的元素前移
+        for (size_t j = (i + 1) & mask; this->buckets_[j] != 0; j = (j + 1) & mask) {
+            size_t k = this->Slot(this->buckets_[j])->hash & mask;
+            if (((j - k) & mask) >= ((j - i) & mask)) {
+                this->buckets_[i] = this->buckets_[j];
+                i = j;
+            }
+        }
+        this->buckets_[i] = 0;
+    }
+
+    int32_t StringPool::Find(wstring_view str) const
+    {
+        if (this->buckets_.empty()) {
+            return 0;
+        }
+        return this->buckets_[this->FindBucket(str, Hash(str))];
+    }
+
+    int32_t StringPool::Intern(wstring_view str)
+    {
+        uint32_t hash = Hash(str);
+        if (!this->buckets_.empty()) {
+            int32_t id = this->buckets_[this->FindBucket(str, hash)];
+            if (id != 0) {
+                //清除期间重新取得的字符串不能被回收
+                this->Slot(id)->mark = this->epoch_;
+                return id;
+            }
+        }
+        this->ReserveBucket();
+        size_t bucket = this->FindBucket(str, hash);
+        int32_t id = ++this->last_id_;
+        this->Insert(id, str, hash);
+        this->buckets_[bucket] = id;
+        return id;
+    }
+
+    int32_t StringPool::Pin(wstring_view str)
+    {
+        int32_t id = this->Intern(str);
+        this->Slot(id)->is_pinned = 1;
+        return id;
+    }
+
+    void StringPool::Unpin(int32_t id)
+    {
+        Header* header = this->Slot(id);
+        if (header != nullptr) {
+            header->is_pinned = 0;
+        }
+    }
+
+    int32_t StringPool::Append(int32_t id, wstring_view str)
+    {
+        if (str.empty() && this->Contains(id)) {
+            return id;
+        }
+        auto it = this->ropes_.find(id);
+        if (it != this->ropes_.end() && it->second.length == it->second.buffer->size()) {
+            //在最后一个id后拼接，直接追加
+            shared_ptr<wstring> buffer = it->second.buffer;
+            const wchar_t* begin = buffer->data();
+            if (str.data() >= begin && str.data() < begin + buffer->size()) {
+                buffer->append(wstring(str));
+            }
+            else {
+                buffer->append(str);
+            }
+            return this->InsertRope(-(++this->last_id_), buffer, str.size());
+        }
+        wstring_view head = this->View(id);
+        if (head.size() + str.size() < kRopeMinLength) {
+            wstring joined;
+            joined.reserve(head.size() + str.size());
+            joined.append(head).append(str);
+            return this->Intern(joined);
+        }
+        auto buffer = make_shared<wstring>();
+        buffer->reserve((head.size() + str.size()) * 2);
+        buffer->append(head).append(str);
+        return this->InsertRope(-(++this->last_id_), buffer, buffer->size());
+    }
+
+    int32_t StringPool::InsertRope(int32_t id, const shared_ptr<wstring>& buffer, size_t appended)
+    {
+        uint32_t size = (uint32_t)(sizeof(Rope) + appended * sizeof(wchar_t));
+        //新字符串视为已标记
+        this->ropes_.emplace(id, Rope{ buffer, (uint32_t)buffer->size(), this->epoch_, 0, size });
+        this->rope_bytes_ += size;
+        this->allocated_bytes_ += size;
+        return id;
+    }
+
+    wstring_view StringPool::Get(int32_t id)
+    {
+        if (id < 0) {
+            auto it = this->ropes_.find(id);
+            if (it == this->ropes_.end()) {
+                return wstring_view();
+            }
+            Rope& rope = it->second;
+            if (rope.flat_id == 0) {
+                rope.flat_id = this->Intern(wstring_view(rope.buffer->data(), rope.length));
+            }
+            id = rope.flat_id;
+        }
+        return this->View(id);
+    }
+
+    wstring_view StringPool::View(int32_t id) const
+    {
+        if (id < 0) {
+            auto it = this->ropes_.find(id);
+            if (it == this->ropes_.end()) {
+                return wstring_view();
+            }
+            return wstring_view(it->second.buffer->data(), it->second.length);
+        }
+        const Header* header = this->Slot(id);
+        if (header == nullptr) {
+            return wstring_view();
+        }
+        return header->view();
+    }
+
+    bool StringPool::Equals(int32_t x, int32_t y) const
+    {
+        if (x == y) {
+            return true;
+        }
+        const Header* a = this->Slot(x);
+        const Header* b = this->Slot(y);
+        if (a == nullptr || b == nullptr) {
+            return this->View(x) == this->View(y);
+        }
+        return a->length == b->length && a->hash == b->hash && a->view() == b->view();
+    }
+
+    void StringPool::Erase(int32_t id)
+    {
+        if (id < 0) {
+            auto it = this->ropes_.find(id);
+            if (it != this->ropes_.end()) {
+                this->rope_bytes_ -= it->second.size;
+                this->ropes_.erase(it);
+            }
+            return;
+        }
+        Header* header = this->Slot(id);
+        if (header == nullptr) {
+            return;
+        }
+        this->EraseBucket(id, header->hash);
+        this->live_bytes_ -= EntrySize(header->length);
+        this->size_--;
+        this->SetSlot(id, nullptr);
+    }
+
+    void StringPool::Clear()
+    {
+        decltype(this->buckets_)().swap(this->buckets_);
+        decltype(this->pages_)().swap(this->pages_);
+        decltype(this->slabs_)().swap(this->slabs_);
+        decltype(this->ropes_)().swap(this->ropes_);
+        this->size_ = 0;
+        this->last_id_ = 0;
+        this->is_unique_ = true;
+        this->is_sweeping_ = false;
+        this->live_bytes_ = 0;
+        this->rope_bytes_ = 0;
+        this->arena_bytes_ = 0;
+        this->allocated_bytes_ = 0;
+    }
+
+    void StringPool::Restore(int32_t id, wstring_view str)
+    {
+        this->Erase(id);
+        if (id < 0) {
+            this->InsertRope(id, make_shared<wstring>(str), str.size());
+            return;
+        }
+        uint32_t hash = Hash(str);
+        this->ReserveBucket();
+        size_t bucket = this->FindBucket(str, hash);
+        this->Insert(id, str, hash);
+        if (this->buckets_[bucket] == 0) {
+            this->buckets_[bucket] = id;
+            return;
+        }
+        this->is_unique_ = false;
+        if (this->buckets_[bucket] < id) {
+            this->buckets_[bucket] = id;
+        }
+    }
+
+    void StringPool::BeginCollect()
+    {
+        this->epoch_ = (this->epoch_ + 1) & kMarkMask;
+        this->is_sweeping_ = true;
+        this->sweep_cursor_ = 1;
+        this->allocated_bytes_ = 0;
+    }
+
+    void StringPool::Mark(int32_t id)
+    {
+        if (id < 0) {
+            auto it = this->ropes_.find(id);
+            if (it != this->ropes_.end()) {
+                it->second.mark = this->epoch_;
+                //展开后的字符串随之存活
+                this->Mark(it->second.flat_id);
+            }
+            return;
+        }
+        Header* header = this->Slot(id);
+        if (header != nullptr) {
+            header->mark = this->epoch_;
+        }
+    }
+
+    bool StringPool::Sweep(size_t count)
+    {
+        if (!this->is_sweeping_) {
+            return true;
+        }
+        int32_t end = (int32_t)(this->pages_.size() << kPageBits);
+        int32_t id = this->sweep_cursor_;
+        for (; id < end && count > 0; count--) {
+            if (!this->pages_[id >> kPageBits]) {
+                //跳过整页
+                id = ((id >> kPageBits) + 1) << kPageBits;
+                continue;
+            }
+            Header* header = this->Slot(id);
+            if (header != nullptr && header->mark != this->epoch_ && !header->is_pinned) {
+                this->Erase(id);
+            }
+            id++;
+        }
+        if (id < end) {
+            this->sweep_cursor_ = id;
+            return false;
+        }
+        this->is_sweeping_ = false;
+        this->SweepRopes();
+        if (this->arena_bytes_ - this->live_bytes_ > (std::max)(this->live_bytes_, kSlabSize)) {
+            this->Compact();
+        }
+        return true;
+    }
+
+    void StringPool::SweepRopes()
+    {
+        for (auto it = this->ropes_.begin(); it != this->ropes_.end();) {
+            if (it->second.mark != this->epoch_) {
+                this->rope_bytes_ -= it->second.size;
+                it = this->ropes_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    void StringPool::Compact()
+    {
+        vector<Slab> old;
+        old.swap(this->slabs_);
+        this->arena_bytes_ = 0;
+        for (auto& page : this->pages_) {
+            if (!page) {
+                continue;
+            }
+            for (Header*& slot : page->slots) {
+                if (slot == nullptr) {
+                    continue;
+                }
+                size_t size = EntrySize(slot->length);
+                Header* header = this->Allocate(size);
+                memcpy(header, slot, size);
+                slot = header;
+            }
+        }
+        //清除后散列表可能过于稀疏
+        size_t capacity = 16;
+        while (capacity < this->size_ * 2) {
+            capacity *= 2;
+        }
+        if (capacity < this->buckets_.size()) {
+            this->Rehash(capacity);
+        }
+    }
+}
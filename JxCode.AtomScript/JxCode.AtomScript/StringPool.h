@@ -0,0 +1,133 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+namespace jxcode::atomscript
+{
+    //解释器的字符串池，相同内容只保存一份，按内容散列查找
+    //id从1开始递增分配，分配后不再改变，0表示不存在
+    //回收为标记清除：开始时由调用方标记仍被引用的字符串，之后分步清除未标记的字符串，
+    //清除期间新分配或被重新取得的字符串视为已标记，常驻的字符串不会被清除
+    //  字符串连同头部（长度、散列、标记）连续保存在分块分配的内存中，
+    //  id经分页的id表找到头部，散列表只保存id，扩容时使用头部缓存的散列
+    //  清除完成后已释放的空间超过存活的字符串时整理内存，取得的字符串视图随之失效
+    //拼接生成的长字符串为负的id，内容保存在可追加的缓冲区中，不参与去重：
+    //  多个id共享一个缓冲区，各自只引用前length个字符，在最后一个id后拼接时直接追加到缓冲区
+    //  Get时才复制为普通字符串（展开），之后返回展开后的字符串
+    class StringPool
+    {
+    protected:
+        struct Header
+        {
+            uint32_t length;
+            uint32_t hash;
+            uint32_t mark : 31;
+            uint32_t is_pinned : 1;
+
+            std::wstring_view view() const { return std::wstring_view(reinterpret_cast<const wchar_t*>(this + 1), this->length); }
+        };
+        struct Slab
+        {
+            std::unique_ptr<char[]> data;
+            size_t capacity;
+            size_t used;
+        };
+        static constexpr int kPageBits = 10;
+        static constexpr int32_t kPageSize = 1 << kPageBits;
+        struct Page
+        {
+            Header* slots[kPageSize];
+            int32_t count;
+        };
+        struct Rope
+        {
+            std::shared_ptr<std::wstring> buffer;
+            uint32_t length;
+            uint32_t mark;
+            int32_t flat_id;  // 展开后的id，未展开时为0
+            uint32_t size;    // 计入存活字节数的大小
+        };
+        static constexpr size_t kSlabSize = 64 * 1024;
+        static constexpr uint32_t kMarkMask = 0x7fffffff;
+    protected:
+        std::vector<Slab> slabs_;                // 最后一块用于分配
+        std::vector<std::unique_ptr<Page>> pages_; // 按id的高位分页，全部释放的页为空
+        std::vector<int32_t> buckets_;           // 线性探测的散列表，0为空位
+        std::unordered_map<int32_t, Rope> ropes_; // 按负的id
+        size_t size_;
+        int32_t last_id_;
+        bool is_unique_;          // 没有内容相同的两个id
+
+        uint32_t epoch_;          // 当前回收的标记值
+        bool is_sweeping_;
+        int32_t sweep_cursor_;    // 下一个待清除的id
+        size_t live_bytes_;       // 普通字符串占用的字节数
+        size_t rope_bytes_;       // 拼接的字符串各自追加的字节数
+        size_t arena_bytes_;      // 已分配的块中使用的字节数，包括已释放的字符串
+        size_t allocated_bytes_;  // 上次回收开始以来分配的字节数
+    public:
+        //拼接结果短于此长度时仍作为普通字符串去重
+        static constexpr size_t kRopeMinLength = 64;
+    public:
+        StringPool();
+        StringPool(const StringPool&) = delete;
+        StringPool& operator=(const StringPool&) = delete;
+    public:
+        //不存在时返回0
+        int32_t Find(std::wstring_view str) const;
+        //不存在时分配新的id
+        int32_t Intern(std::wstring_view str);
+        //与Intern相同，并且字符串常驻直到Unpin
+        int32_t Pin(std::wstring_view str);
+        void Unpin(int32_t id);
+        //拼接id的字符串与str，返回新的id
+        int32_t Append(int32_t id, std::wstring_view str);
+        //不存在的id返回空字符串，视图在字符串被清除或整理内存前有效，拼接的字符串先展开
+        std::wstring_view Get(int32_t id);
+        //与Get相同但不展开，拼接的字符串的视图在下次拼接前有效
+        std::wstring_view View(int32_t id) const;
+        bool Contains(int32_t id) const { return id < 0 ? this->ropes_.count(id) != 0 : this->Slot(id) != nullptr; }
+        //先比较长度与散列，不存在的id视为空字符串
+        bool Equals(int32_t x, int32_t y) const;
+        void Erase(int32_t id);
+        void Clear();
+        //反序列化时按原来的id恢复，内容重复时查找结果为id较大的一个
+        void Restore(int32_t id, std::wstring_view str);
+        //最后分配的id，反序列化时恢复
+        int32_t last_id() const { return this->last_id_; }
+        void set_last_id(int32_t id) { this->last_id_ = id; }
+        size_t size() const { return this->size_ + this->ropes_.size(); }
+        //为true时id不同的非负id的字符串内容一定不同，只有恢复的内容重复时为false
+        bool is_unique() const { return this->is_unique_; }
+    public:
+        //开始新一轮回收，未完成的清除被放弃
+        void BeginCollect();
+        void Mark(int32_t id);
+        //最多检查count个id，返回清除是否完成
+        bool Sweep(size_t count);
+        bool is_sweeping() const { return this->is_sweeping_; }
+        size_t live_bytes() const { return this->live_bytes_ + this->rope_bytes_; }
+        size_t allocated_bytes() const { return this->allocated_bytes_; }
+    protected:
+        static uint32_t Hash(std::wstring_view str) { return (uint32_t)std::hash<std::wstring_view>()(str); }
+        static size_t EntrySize(size_t length);
+        Header* Slot(int32_t id) const;
+        void SetSlot(int32_t id, Header* header);
+        Header* Allocate(size_t size);
+        Header* Insert(int32_t id, std::wstring_view str, uint32_t hash);
+        //返回内容相同的id所在的位置，不存在时返回应插入的空位
+        size_t FindBucket(std::wstring_view str, uint32_t hash) const;
+        void ReserveBucket();
+        void Rehash(size_t capacity);
+        void EraseBucket(int32_t id, uint32_t hash);
+        //把存活的字符串按id顺序复制到新的块中
+        void Compact();
+        //appended为新追加的字符数，计入分配的字节数
+        int32_t InsertRope(int32_t id, const std::shared_ptr<std::wstring>& buffer, size_t appended);
+        void SweepRopes();
+    };
+}
@@ -0,0 +1,26 @@
+#include "SymbolTable.h"
+
+namespace jxcode::atomscript
+{
+    using namespace std;
+
+    int32_t SymbolTable::Find(wstring_view name) const
+    {
+        auto it = this->index_.find(name);
+        if (it == this->index_.end()) {
+            return -1;
+        }
+        return it->second;
+    }
+
+    int32_t SymbolTable::Intern(wstring_view name)
+    {
+        auto it = this->index_.find(name);
+        if (it != this->index_.end()) {
+            return it->second;
+        }
+        int32_t slot = (int32_t)this->index_.size();
+        this->index_.emplace(wstring(name), slot);
+        return slot;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <map>
+
+namespace jxcode::atomscript
+{
+    //变量名到槽位下标的映射，槽位只增不减，编译后的指令直接使用槽位访问变量
+    class SymbolTable
+    {
+    public:
+        using index_type = std::map<std::wstring, int32_t, std::less<>>;
+    protected:
+        index_type index_;
+    public:
+        //不存在时返回-1
+        int32_t Find(std::wstring_view name) const;
+        //不存在时分配新的槽位
+        int32_t Intern(std::wstring_view name);
+        size_t size() const { return this->index_.size(); }
+        //按名字排序
+        const index_type& index() const { return this->index_; }
+    };
+}
@@ -1,10 +1,23 @@
 #include "Token.h"
 #include <sstream>
+#include <unordered_map>
+#include "Utf8.h"
 
 namespace jxcode::lexer 
 {
+    inline static std::wstring_view ToWideView(std::wstring_view str, std::wstring*)
+    {
+        return str;
+    }
+    inline static std::wstring_view ToWideView(std::string_view str, std::wstring* buffer)
+    {
+        *buffer = Utf8ToWide(str);
+        return *buffer;
+    }
 
-    std::wstring Token::to_string() const {
+    template<typename CharT>
+    std::wstring BasicToken<CharT>::to_string() const {
+        std::wstring buffer;
         std::wstringstream ss;
         ss << L"TokenType: ";
         ss << (int)this->token_type;
@@ -12,19 +25,88 @@ namespace jxcode::lexer
         ss << this->line;
         ss << L", Position: ";
         ss << this->position;
-        ss << L", Value: " << *this->value;
+        ss << L", Value: " << ToWideView(this->value, &buffer);
         ss << L". ";
         return ss.str();
     }
 
-    TokenException::TokenException(const std::shared_ptr<Token>& token, const std::wstring& message)
-        : token_(token), wexceptionbase(message)
+    template<typename CharT>
+    BasicTokenList<CharT>::BasicTokenList()
+    {
+    }
+
+    template<typename CharT>
+    BasicTokenList<CharT>::BasicTokenList(const std::shared_ptr<const std::basic_string<CharT>>& source)
+        : source(source)
+    {
+    }
+
+    template<typename CharT>
+    std::basic_string_view<CharT> BasicTokenList<CharT>::Store(std::basic_string<CharT>&& str)
+    {
+        //deque尾部插入不会移动已有元素，视图保持有效
+        this->storage_.push_back(std::move(str));
+        return this->storage_.back();
+    }
+
+    template<typename CharT>
+    void BasicTokenList<CharT>::Append(BasicTokenList&& other)
+    {
+        this->tokens.insert(this->tokens.end(), other.tokens.begin(), other.tokens.end());
+        decltype(other.tokens)().swap(other.tokens);
+        //移动deque与shared_ptr不会改变字符串的地址
+        this->retained_.push_back(std::move(other));
+    }
+
+    template class BasicToken<wchar_t>;
+    template class BasicToken<char>;
+    template class BasicTokenList<wchar_t>;
+    template class BasicTokenList<char>;
+
+    TokenList WidenTokenList(const Utf8TokenList& tokens)
+    {
+        TokenList wide;
+        wide.tokens.reserve(tokens.tokens.size());
+        std::unordered_map<std::string_view, std::wstring_view> converted;
+        for (const Utf8Token& token : tokens.tokens) {
+            auto it = converted.find(token.value);
+            if (it == converted.end()) {
+                it = converted.emplace(token.value, wide.Store(Utf8ToWide(token.value))).first;
+            }
+            wide.tokens.push_back(Token{ token.token_type, it->second, token.line, token.position });
+        }
+        return wide;
+    }
+
+    TokenInterner::TokenInterner(TokenList* owner)
+        : owner_(owner)
+    {
+    }
+
+    std::wstring_view TokenInterner::Intern(std::wstring_view value)
+    {
+        auto it = this->values_.find(value);
+        if (it != this->values_.end()) {
+            return *it;
+        }
+        std::wstring_view stored = this->owner_->Store(std::wstring(value));
+        this->values_.insert(stored);
+        return stored;
+    }
+
+    std::wstring_view TokenInterner::Intern(std::string_view utf8_value)
+    {
+        return this->Intern(Utf8ToWide(utf8_value));
+    }
+
+    TokenException::TokenException(const Token& token, const std::wstring& message)
+        : token_string_(token.to_string()), wexceptionbase(message)
     {
     }
 
     std::wstring TokenException::what()
     {
-        return this->get_name() + this->token_->to_string() + this->message_;
+        return this->get_name() + this->token_string_ + this->message_;
     }
 
 }
\ No newline at end of file
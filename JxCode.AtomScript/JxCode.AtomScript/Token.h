@@ -1,6 +1,10 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <memory>
+#include <vector>
+#include <deque>
+#include <unordered_set>
 #include "wexceptionbase.h"
 
 namespace jxcode::lexer
@@ -47,29 +51,89 @@ namespace jxcode::lexer
         Pound,
         Doller,
         Precent,
-        Question
+        Question,
+        //关键字，只在命令开头有意义
+        Call,
+        Goto,
+        If,
+        Then,
+        Var,
+        Set,
+        ClearSub,
+        Del,
+        ToProg,
+        Label
     };
 
-    class Token
+    //value为源码缓冲区（或TokenList中转义字符串）的视图，不持有内存
+    //CharT为wchar_t时是宽字符源码，为char时是UTF-8源码
+    template<typename CharT>
+    class BasicToken
     {
     public:
         TokenType token_type;
-        std::shared_ptr<std::wstring> program_name;
-        std::shared_ptr<std::wstring> value;
+        std::basic_string_view<CharT> value;
         size_t line;
         size_t position;
     public:
         std::wstring to_string() const;
     };
 
+    //扁平的Token数组，并持有Token视图所引用的源码与转义后的字符串
+    template<typename CharT>
+    class BasicTokenList
+    {
+    public:
+        std::shared_ptr<const std::basic_string<CharT>> source;
+        std::vector<BasicToken<CharT>> tokens;
+    protected:
+        std::deque<std::basic_string<CharT>> storage_;
+        //Append合并进来的列表，只用于保持其源码与字符串存储存活
+        std::vector<BasicTokenList> retained_;
+    public:
+        BasicTokenList();
+        explicit BasicTokenList(const std::shared_ptr<const std::basic_string<CharT>>& source);
+        BasicTokenList(const BasicTokenList&) = delete;
+        BasicTokenList(BasicTokenList&&) = default;
+        BasicTokenList& operator=(const BasicTokenList&) = delete;
+        BasicTokenList& operator=(BasicTokenList&&) = default;
+    public:
+        std::basic_string_view<CharT> Store(std::basic_string<CharT>&& str);
+        //把other的Token追加到尾部，并接管other的缓冲区，已有的视图保持有效
+        void Append(BasicTokenList&& other);
+    };
+
+    using Token = BasicToken<wchar_t>;
+    using TokenList = BasicTokenList<wchar_t>;
+    using Utf8Token = BasicToken<char>;
+    using Utf8TokenList = BasicTokenList<char>;
+
+    //把Token的值复制到owner的存储中，相同的值只保存一次
+    //用于释放源码后仍需保留的Token，例如分块解析出的命令
+    class TokenInterner
+    {
+    protected:
+        TokenList* owner_;
+        std::unordered_set<std::wstring_view> values_;
+    public:
+        explicit TokenInterner(TokenList* owner);
+    public:
+        std::wstring_view Intern(std::wstring_view value);
+        std::wstring_view Intern(std::string_view utf8_value);
+    };
+
+    //UTF-8 Token转为宽字符Token，相同的值只转换一次，结果不再引用UTF-8源码
+    TokenList WidenTokenList(const Utf8TokenList& tokens);
+
     class TokenException : public wexceptionbase
     {
     protected:
-        std::shared_ptr<Token> token_;
+        //抛出时的Token快照，异常可能在源码释放后才被读取
+        std::wstring token_string_;
     protected:
         virtual std::wstring get_name() = 0;
     public:
-        TokenException(const std::shared_ptr<Token>& token, const std::wstring& message);
+        TokenException(const Token& token, const std::wstring& message);
     public:
         virtual std::wstring what() override;
     };
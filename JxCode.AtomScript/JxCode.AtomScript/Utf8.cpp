@@ -0,0 +1,107 @@
+#include "Utf8.h"
+
+namespace jxcode::lexer
+{
+    static constexpr char32_t kReplacementChar = 0xFFFD;
+
+    inline static void AppendCodePoint(std::wstring* out, char32_t cp)
+    {
+        if constexpr (sizeof(wchar_t) == 2) {
+            if (cp >= 0x10000) {
+                cp -= 0x10000;
+                out->push_back((wchar_t)(0xD800 + (cp >> 10)));
+                out->push_back((wchar_t)(0xDC00 + (cp & 0x3FF)));
+                return;
+            }
+        }
+        out->push_back((wchar_t)cp);
+    }
+
+    std::wstring Utf8ToWide(std::string_view str)
+    {
+        std::wstring out;
+        out.reserve(str.length());
+        size_t i = 0;
+        size_t length = str.length();
+        while (i < length) {
+            unsigned char c = (unsigned char)str[i];
+            if (c < 0x80) {
+                out.push_back((wchar_t)c);
+                ++i;
+                continue;
+            }
+            size_t count;
+            char32_t cp;
+            char32_t min;
+            if ((c & 0xE0) == 0xC0) {
+                count = 1; cp = c & 0x1F; min = 0x80;
+            }
+            else if ((c & 0xF0) == 0xE0) {
+                count = 2; cp = c & 0x0F; min = 0x800;
+            }
+            else if ((c & 0xF8) == 0xF0) {
+                count = 3; cp = c & 0x07; min = 0x10000;
+            }
+            else {
+                AppendCodePoint(&out, kReplacementChar);
+                ++i;
+                continue;
+            }
+            size_t j = 1;
+            for (; j <= count && i + j < length; j++) {
+                unsigned char cc = (unsigned char)str[i + j];
+                if ((cc & 0xC0) != 0x80) {
+                    break;
+                }
+                cp = (cp << 6) | (cc & 0x3F);
+            }
+            if (j <= count || cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+                AppendCodePoint(&out, kReplacementChar);
+                i += j;
+                continue;
+            }
+            AppendCodePoint(&out, cp);
+            i += j;
+        }
+        return out;
+    }
+
+    std::string WideToUtf8(std::wstring_view str)
+    {
+        std::string out;
+        out.reserve(str.length());
+        size_t length = str.length();
+        for (size_t i = 0; i < length; i++) {
+            char32_t cp = (char32_t)str[i];
+            if constexpr (sizeof(wchar_t) == 2) {
+                if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < length
+                    && (char32_t)str[i + 1] >= 0xDC00 && (char32_t)str[i + 1] <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + ((char32_t)str[i + 1] - 0xDC00);
+                    ++i;
+                }
+            }
+            if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+                cp = kReplacementChar;
+            }
+            if (cp < 0x80) {
+                out.push_back((char)cp);
+            }
+            else if (cp < 0x800) {
+                out.push_back((char)(0xC0 | (cp >> 6)));
+                out.push_back((char)(0x80 | (cp & 0x3F)));
+            }
+            else if (cp < 0x10000) {
+                out.push_back((char)(0xE0 | (cp >> 12)));
+                out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back((char)(0x80 | (cp & 0x3F)));
+            }
+            else {
+                out.push_back((char)(0xF0 | (cp >> 18)));
+                out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+                out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back((char)(0x80 | (cp & 0x3F)));
+            }
+        }
+        return out;
+    }
+}
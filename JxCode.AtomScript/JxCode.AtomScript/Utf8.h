@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+namespace jxcode::lexer
+{
+    //UTF-8与宽字符互转，wchar_t为2字节时使用UTF-16代理对
+    //非法的UTF-8序列转换为U+FFFD
+    std::wstring Utf8ToWide(std::string_view str);
+    std::string WideToUtf8(std::wstring_view str);
+}